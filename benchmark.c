@@ -0,0 +1,159 @@
+// Measures the throughput of json_next_token() and, on Linux, the branches and branch misses.
+// Build it twice, with and without JSON_COMPUTED_GOTO, to compare the dispatch of the state machine.
+//
+//     json_benchmark [file.json] [repeat]
+//
+// Without a file a document of 200000 person records is generated in memory.
+
+// clock_gettime() and, on Linux, syscall() are not declared by a strict -std=c99 without these.
+#define _POSIX_C_SOURCE 200809L
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#define JSON_TOKENIZER_IMPLEMENTATION
+#include "json_tokenizer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Double the capacity of data, frees it and returns NULL if that fails.
+static char* grow(char* data, size_t* capacity)
+{
+	char* grown = (char*)realloc(data, *capacity *= 2);
+	if (grown == NULL) free(data);
+	return grown;
+}
+
+static char* generate(size_t* size)
+{
+	size_t capacity = 1 << 20, len = 0;
+	char* data = (char*)malloc(capacity);
+	if (data == NULL) return NULL;
+	len += (size_t)snprintf(data, capacity, "[\n");
+	for (int i = 0; i < 200000; i++) {
+		// A record is less than 512 bytes, the check after snprintf() catches it if that changes.
+		if (capacity - len < 512 && (data = grow(data, &capacity)) == NULL) return NULL;
+		int n = snprintf(data + len, capacity - len,
+			"\t{\"age\": %d, \"name\": \"Person %d\", \"score\": %d.%03d, \"active\": %s, \"email\": null,\n"
+			"\t \"tags\": [\"a\", \"bc\", \"d\\u00e9f\"], \"address\": {\"street\": \"Main \\\"%d\\\"\", \"zip\": %d}}%s\n",
+			i % 100, i, i % 10, i % 1000, (i & 1) ? "true" : "false", i, 10000 + i % 90000, i < 199999 ? "," : "");
+		if (n < 0 || (size_t)n >= capacity - len) {
+			free(data);
+			return NULL;
+		}
+		len += (size_t)n;
+	}
+	if (capacity - len < 512 && (data = grow(data, &capacity)) == NULL) return NULL;
+	len += (size_t)snprintf(data + len, capacity - len, "]\n");
+	*size = len;
+	return data;
+}
+
+static char* load(const char* filename, size_t* size)
+{
+	FILE* fp = fopen(filename, "rb");
+	if (fp == NULL) return NULL;
+	size_t capacity = 1 << 20, len = 0, n;
+	char* data = (char*)malloc(capacity);
+	while (data != NULL && (n = fread(data + len, 1, capacity - len, fp)) > 0) {
+		len += n;
+		if (len == capacity) data = (char*)realloc(data, capacity *= 2);
+	}
+	fclose(fp);
+	*size = len;
+	return data;
+}
+
+#ifdef __linux__
+static int perf_open(uint64_t config)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+	size_t size = 0;
+	char* data = argc > 1 ? load(argv[1], &size) : generate(&size);
+	int repeat = argc > 2 ? atoi(argv[2]) : 5;
+	if (data == NULL) {
+		printf("Can not read %s\n", argc > 1 ? argv[1] : "input");
+		return 1;
+	}
+
+	int branches = -1, misses = -1;
+#ifdef __linux__
+	branches = perf_open(PERF_COUNT_HW_BRANCH_INSTRUCTIONS);
+	misses = perf_open(PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+
+	double best = 1e9;
+	long long tokens = 0, best_branches = -1, best_misses = -1;
+	for (int r = 0; r < repeat; r++) {
+		struct timespec start, end;
+		json_token_t tok;
+		tokens = 0;
+#ifdef __linux__
+		if (branches >= 0) { ioctl(branches, PERF_EVENT_IOC_RESET, 0); ioctl(branches, PERF_EVENT_IOC_ENABLE, 0); }
+		if (misses >= 0) { ioctl(misses, PERF_EVENT_IOC_RESET, 0); ioctl(misses, PERF_EVENT_IOC_ENABLE, 0); }
+#endif
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		json_t* json = json_open_memory(data, size);
+		while ((tok = json_next_token(json)) != JSON_END_DOCUMENT && tok != JSON_ERROR) tokens++;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+#ifdef __linux__
+		long long count;
+		if (branches >= 0) ioctl(branches, PERF_EVENT_IOC_DISABLE, 0);
+		if (misses >= 0) ioctl(misses, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+		if (tok == JSON_ERROR) {
+			printf("%s\n", json_get_error(json));
+			json_close(json);
+			return 1;
+		}
+		json_close(json);
+
+		double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) * 1e-9;
+		if (seconds < best) {
+			best = seconds;
+#ifdef __linux__
+			if (branches >= 0 && read(branches, &count, sizeof(count)) == sizeof(count)) best_branches = count;
+			if (misses >= 0 && read(misses, &count, sizeof(count)) == sizeof(count)) best_misses = count;
+#endif
+		}
+	}
+
+#ifdef JSON_COMPUTED_GOTO
+	printf("dispatch:      computed goto\n");
+#else
+	printf("dispatch:      switch\n");
+#endif
+	printf("input:         %.1f MB, %lld tokens\n", (double)size / 1e6, tokens);
+	printf("throughput:    %.1f MB/s, %.1f Mtokens/s (best of %d)\n", (double)size / 1e6 / best, (double)tokens / 1e6 / best, repeat);
+	if (best_branches >= 0 && best_misses >= 0) {
+		printf("branches:      %lld (%.2f per byte)\n", best_branches, (double)best_branches / (double)size);
+		printf("branch-misses: %lld (%.2f%%, %.1f per 1000 tokens)\n", best_misses,
+			100.0 * (double)best_misses / (double)best_branches, 1000.0 * (double)best_misses / (double)tokens);
+	}
+	else printf("branch-misses: n/a\n");
+	free(data);
+	return 0;
+}
@@ -28,6 +28,59 @@
 *      By default the stdlib fopen(), fgetc() and free() is used. You can defines you own
 *      by defining these symbols. You most either define all three, or neither
 *
+*    #define JSON_FREAD(fp,buf,size)      better_fread
+*
+*      Read up to size bytes and return the number of bytes read. By default fread() is used
+*      or, if you defined your own JSON_FGETC, a loop over JSON_FGETC.
+*
+*    #define JSON_FSEEK(fp,offset)        better_fseek
+*
+*      Seek to a 64-bit byte offset from the start of the file and return 0 on success, used by
+*      json_seek_element(). By default fseeko() or _fseeki64() is used, if you defined your own
+*      JSON_FOPEN files can only be seeked if you define it too.
+*
+*    #define JSON_BUFFER_SIZE 65536
+*
+*      Size in bytes of the input buffer of each json_t.
+*
+*    #define JSON_COMPUTED_GOTO
+*
+*      Dispatch the states of json_next_token() with computed gotos (labels as values) instead
+*      of a switch, on GCC and Clang. Other compilers use the switch.
+*
+*    #define JSON_ZLIB
+*    #define JSON_ZSTD
+*
+*      Enable json_inflate() and json_zstd() that decompress gzip/zlib or zstd input
+*      on the fly. You must link with zlib or libzstd.
+*
+*    #define JSON_READAHEAD
+*
+*      Enable json_readahead() and json_fopen_readahead() on POSIX systems, they read the
+*      input on a helper thread. You must link with pthreads.
+*
+*  INPUT
+*
+*    json_fopen() reads a file. json_open_reader() reads from any source through a read
+*    callback, json_open_fd() reads from a file descriptor and json_open_memory() reads a
+*    buffer in place without copying. When the source has no input available yet
+*    json_next_token() returns JSON_WOULD_BLOCK and continues where it left off on the next
+*    call, so one thread can tokenize many sockets or pipes from an event loop, see json_pump().
+*
+*    json_set_schema() validates the document against a compiled json schema while it is
+*    tokenized, violations are returned as JSON_ERROR.
+*
+*    json_get_offset() is the 64-bit byte offset of a token in the input. For huge documents
+*    with an array at the top, json_index_build() records where every Nth element starts and
+*    json_seek_element() starts tokenizing at any element without reading what comes before
+*    it. The index can be saved next to the document with json_index_save().
+*
+*    json_extract_columns() turns a stream of flat records into typed columns with the memory
+*    layout of Apache Arrow.
+*
+*    json_minify() and json_pretty() copy a document from a json_t to a json_writer_t
+*    without decoding strings and numbers, memory use is bounded by the largest string.
+*
 *  LICENSE
 * 
 *    Placed in the public domain and also MIT licensed.
@@ -68,26 +121,152 @@ typedef enum {
 	JSON_DOUBLE,
 	JSON_BOOLEAN,
 	JSON_NULL,
-	JSON_ERROR
+	JSON_ERROR,
+	JSON_WOULD_BLOCK
 } json_token_t;
 
+/** Return values of json_reader_t.read besides the number of bytes read. */
+#define JSON_READ_ERROR (-1)
+#define JSON_READ_AGAIN (-2)
+
+/** @brief An input source for json_open_reader().
+*
+*   read  Read at most size bytes into buf. Return the number of bytes read, 0 at the end of
+*         the input, JSON_READ_ERROR on failure or JSON_READ_AGAIN if no input is available yet.
+*         JSON_READ_AGAIN makes json_next_token() return JSON_WOULD_BLOCK, call it again when
+*         there is more input and it continues where it left off.
+*   close Called by json_close(), may be NULL.
+*   user  Passed to read, close and seek.
+*   seek  Move to a byte offset from the start of the input and return 0 on success. May be NULL,
+*         then json_seek_element() fails.
+*/
+typedef struct json_reader {
+	intptr_t (*read)(void* user, void* buf, size_t size);
+	void (*close)(void* user);
+	void* user;
+	int (*seek)(void* user, uint64_t offset);
+} json_reader_t;
+
 /** @brief Open a json file for reading.
 *   @param filename Name of the xml file.
 *   @return NULL on failure och a pointer to a json structure on success.
 */
 json_t* json_fopen(const char* filename);
 
+/** @brief Open a file as a reader, to be passed on to json_open_reader().
+*   @param reader The reader to fill in.
+*   @param filename Name of the json file.
+*   @return 0 on success, -1 on failure.
+*/
+int json_file_reader(json_reader_t* reader, const char* filename);
+
+/** @brief Make a reader decompress gzip or zlib data, requires JSON_ZLIB.
+*
+*   Concatenated gzip members are read as one stream. Decompression happens in bounded
+*   chunks straight into the tokenizer's input buffer. Wrap the result with json_readahead()
+*   to decompress on a helper thread.
+*
+*   @param reader The reader to wrap, on success it is replaced by the decompressing reader.
+*   @return 0 on success, -1 on failure and the reader is left untouched.
+*/
+int json_inflate(json_reader_t* reader);
+
+/** @brief Make a reader decompress zstd data, requires JSON_ZSTD.
+*   @param reader The reader to wrap, on success it is replaced by the decompressing reader.
+*   @return 0 on success, -1 on failure and the reader is left untouched.
+*/
+int json_zstd(json_reader_t* reader);
+
+/** @brief Open a json document from a reader.
+*   @param reader The input source, it is copied.
+*   @return NULL on failure och a pointer to a json structure on success.
+*/
+json_t* json_open_reader(const json_reader_t* reader);
+
+/** @brief Open a json document in memory, the data is not copied and must outlive the json structure.
+*   @param data The json text.
+*   @param size The size of the json text in bytes.
+*   @return NULL on failure och a pointer to a json structure on success.
+*/
+json_t* json_open_memory(const void* data, size_t size);
+
+#if defined(__unix__) || defined(__APPLE__)
+/** @brief Open a json document from a file descriptor, e.g. a socket or a pipe.
+*
+*   If the file descriptor is non-blocking json_next_token() returns JSON_WOULD_BLOCK
+*   when no input is available, wait for the file descriptor to become readable and
+*   call json_next_token() again.
+*
+*   @param fd The file descriptor, it is not closed by json_close().
+*   @return NULL on failure och a pointer to a json structure on success.
+*/
+json_t* json_open_fd(int fd);
+
+/** @brief Make a reader read ahead on a helper thread, requires JSON_READAHEAD.
+*
+*   The helper thread keeps up to count buffers of size bytes filled from the original
+*   reader while json_next_token() consumes the oldest one, so waiting for slow storage
+*   overlaps with tokenizing. The original reader must be blocking.
+*
+*   @param reader The reader to wrap, on success it is replaced by the read-ahead reader.
+*   @param count Number of buffers, at least 2.
+*   @param size Size of each buffer in bytes.
+*   @return 0 on success, -1 on failure and the reader is left untouched.
+*/
+int json_readahead(json_reader_t* reader, int count, size_t size);
+
+/** @brief Open a json file that is read ahead on a helper thread, requires JSON_READAHEAD.
+*   @param filename Name of the json file.
+*   @param count Number of buffers, at least 2.
+*   @param size Size of each buffer in bytes.
+*   @return NULL on failure och a pointer to a json structure on success.
+*/
+json_t* json_fopen_readahead(const char* filename, int count, size_t size);
+#endif
+
 /** @brief Close a json file and free memory for the xml structure.
 *   @param json Pointer to the json structure.
 */
 void json_close(json_t* json);
 
+/** @brief Close the input and start over on a new document from a reader, keeping the buffers.
+*
+*   Cheaper than json_close() and json_open_reader() when many small documents are read one
+*   after the other. The schema and the stream setting are kept.
+*
+*   @param json Pointer to a json structure.
+*   @param reader The new input source, it is copied.
+*/
+void json_reopen(json_t* json, const json_reader_t* reader);
+
 /** @brief Read the next token from the json input
 *   @param json Pointer to a json structure.
 *   @return The next token.
 */
 json_token_t json_next_token(json_t* json);
 
+/** @brief Read tokens and pass them to a callback until the input would block or the document ends.
+*
+*   Meant for event loops: call it when the input becomes readable and it tokenizes all
+*   input that is available without blocking.
+*
+*   @param json Pointer to a json structure.
+*   @param callback Called for each token, return 0 to stop.
+*   @param user Passed to the callback.
+*   @return The last token, JSON_WOULD_BLOCK when waiting for input, JSON_END_DOCUMENT or JSON_ERROR when done.
+*/
+json_token_t json_pump(json_t* json, int (*callback)(void* user, json_t* json, json_token_t tok), void* user);
+
+/** @brief Read a stream of documents separated by whitespace, e.g. NDJSON, instead of one document.
+*
+*   The tokens of each document follow the tokens of the one before, JSON_END_DOCUMENT is returned
+*   at the end of the input. An empty input is an empty stream.
+*
+*   @param json Pointer to a json structure, no tokens should have been read.
+*   @param stream 1 to read a stream, 0 to read one document.
+*/
+void json_set_stream(json_t* json, int stream);
+
 /** @brief Get the name of object, can only be read after a JSON_START_OBJECT token.
 *   @param json Pointer to a json structure.
 *   @return A string to a name if applicable else NULL.
@@ -105,6 +284,297 @@ const char* json_get_value(json_t* json);
 */
 const char* json_get_error(json_t* json);
 
+/** @brief Get the length of the string returned by json_get_name, json_get_value or json_get_error.
+*   @param json Pointer to a json structure.
+*   @return The number of bytes, not counting the terminating zero, or 0 if not applicable.
+*/
+size_t json_get_length(json_t* json);
+
+/** @brief Get the byte offset in the input of the first byte of the last token.
+*   @param json Pointer to a json structure.
+*   @return The offset, for JSON_END_DOCUMENT the size of the input.
+*/
+uint64_t json_get_offset(json_t* json);
+
+typedef struct json__schema json_schema_t;
+
+/** @brief Compile a json schema for json_set_schema().
+*
+*   Supports the keywords type, properties, required, additionalProperties (true or false),
+*   items (one schema), minimum, maximum, exclusiveMinimum, exclusiveMaximum, minLength,
+*   maxLength, minItems and maxItems. Annotations like title and description are ignored,
+*   other keywords are not supported and make the compilation fail. At most 64 keys of an
+*   object can be required.
+*
+*   @param json Pointer to a json structure with the schema, no tokens should have been read.
+*   @return NULL if the schema is invalid or not supported, else a pointer to a compiled schema.
+*/
+json_schema_t* json_schema_compile(json_t* json);
+
+/** @brief Free a compiled schema.
+*   @param schema Pointer to a compiled schema.
+*/
+void json_schema_free(json_schema_t* schema);
+
+/** @brief Validate the document against a schema while it is tokenized.
+*
+*   json_next_token() checks each token as it is read. A token that violates the schema is
+*   not returned, instead JSON_ERROR is returned and json_get_error() tells where and why, e.g.
+*   "Error(3,12): $.persons[2].age: Value is greater than the maximum.". The schema can be
+*   shared by many json structures and must outlive them.
+*
+*   @param json Pointer to a json structure, no tokens should have been read.
+*   @param schema Pointer to a compiled schema, NULL to stop validating.
+*/
+void json_set_schema(json_t* json, const json_schema_t* schema);
+
+typedef struct json__index json_index_t;
+
+/** @brief Read a document with an array at the top and record where every stride:th element starts.
+*
+*   Each entry holds the byte offset, row and column of an element, that is all the state the
+*   tokenizer needs to continue from there.
+*
+*   @param json Pointer to a json structure, no tokens should have been read.
+*   @param stride Record every stride:th element, starting with the first.
+*   @return NULL if the document is invalid (see json_get_error()) or not an array, else a pointer to an index.
+*/
+json_index_t* json_index_build(json_t* json, uint64_t stride);
+
+/** @brief Write an index to a file, the file is json.
+*   @param index Pointer to an index.
+*   @param filename Name of the index file.
+*   @return 0 on success, -1 on failure.
+*/
+int json_index_save(const json_index_t* index, const char* filename);
+
+/** @brief Read an index written by json_index_save().
+*   @param filename Name of the index file.
+*   @return NULL on failure or a pointer to an index.
+*/
+json_index_t* json_index_load(const char* filename);
+
+/** @brief Get the number of elements in the indexed array.
+*   @param index Pointer to an index.
+*   @return The number of elements.
+*/
+uint64_t json_index_count(const json_index_t* index);
+
+/** @brief Free an index.
+*   @param index Pointer to an index.
+*/
+void json_index_free(json_index_t* index);
+
+/** @brief Continue tokenizing at an element of the indexed array.
+*
+*   Seeks the input to the closest indexed element before n and skips the rest, the next token
+*   is the first token of element n. The tokens after the last element are JSON_END_ARRAY and
+*   JSON_END_DOCUMENT. The input must be seekable, see json_reader_t, or in memory, and it must
+*   not block.
+*
+*   @param json Pointer to a json structure opened on the same document as the index.
+*   @param index Pointer to an index.
+*   @param n Index of the element, counted from 0.
+*   @return 0 on success, -1 if n is out of range, the input can not be seeked or is invalid.
+*/
+int json_seek_element(json_t* json, const json_index_t* index, uint64_t n);
+
+typedef enum json_column_type {
+	JSON_COLUMN_INT64,
+	JSON_COLUMN_DOUBLE,
+	JSON_COLUMN_STRING,
+	JSON_COLUMN_BOOLEAN
+} json_column_type_t;
+
+/** @brief A column of values for json_extract_columns().
+*
+*   Set name and type and zero the rest, e.g. json_column_t age = { .name = "age", .type = JSON_COLUMN_INT64 }.
+*   The buffers have the layout of Apache Arrow's Int64, Float64, LargeUtf8 and Boolean arrays:
+*
+*   validity   Bit i, least significant bit first, is set if row i is not null.
+*   values     JSON_COLUMN_INT64: an int64_t per row. JSON_COLUMN_DOUBLE: a double per row.
+*              JSON_COLUMN_STRING: length + 1 int64_t offsets, row i is data[offsets[i]..offsets[i + 1]).
+*              JSON_COLUMN_BOOLEAN: a bit per row, least significant bit first.
+*   data       The UTF-8 bytes of the strings, not zero terminated.
+*/
+typedef struct json_column {
+	const char* name;
+	json_column_type_t type;
+	uint64_t length, null_count, data_size;
+	uint8_t* validity;
+	void* values;
+	char* data;
+	size_t capacity[3];
+} json_column_t;
+
+/** @brief Append the fields of a stream of flat records to columns.
+*
+*   The records are the objects of an array at the top, or the documents of a stream (see
+*   json_set_stream()). Each record adds a row to every column: the value of the field with
+*   the name of the column, or null if the field is missing, null, nested or of another type.
+*   Integers that fit are converted to JSON_COLUMN_DOUBLE but not the other way. Fields
+*   without a column are skipped. The input must not block.
+*
+*   @param json Pointer to a json structure.
+*   @param columns The columns, the values are appended to the rows that are already there.
+*   @param count The number of columns.
+*   @param max_rows Stop after this many records, call again to continue with the next batch.
+*   @return The number of records appended, 0 at the end of the input and -1 if the input is not a
+*           stream of records, then the rows appended so far are kept.
+*/
+int64_t json_extract_columns(json_t* json, json_column_t* columns, int count, int64_t max_rows);
+
+/** @brief Remove all rows of columns but keep the memory, e.g. before the next batch.
+*   @param columns The columns.
+*   @param count The number of columns.
+*/
+void json_columns_clear(json_column_t* columns, int count);
+
+/** @brief Free the memory of columns.
+*   @param columns The columns.
+*   @param count The number of columns.
+*/
+void json_columns_free(json_column_t* columns, int count);
+
+typedef struct json__writer json_writer_t;
+
+/** @brief An output target for json_writer_open().
+*
+*   write Write all size bytes of data. Return 0 on success or -1 on failure.
+*   close Called by json_writer_close(), may be NULL.
+*   user  Passed to write and close.
+*/
+typedef struct json_sink {
+	int (*write)(void* user, const void* data, size_t size);
+	void (*close)(void* user);
+	void* user;
+} json_sink_t;
+
+/** @brief Create a json writer that writes to a sink through a buffer of JSON_BUFFER_SIZE bytes.
+*   @param sink The output target, it is copied.
+*   @return NULL on failure or a pointer to a json writer on success.
+*/
+json_writer_t* json_writer_open(const json_sink_t* sink);
+
+/** @brief Create a json writer that writes to a file.
+*   @param filename Name of the json file.
+*   @return NULL on failure or a pointer to a json writer on success.
+*/
+json_writer_t* json_writer_fopen(const char* filename);
+
+#if defined(__unix__) || defined(__APPLE__)
+/** @brief Create a json writer that writes to a file descriptor, it is not closed by json_writer_close().
+*   @param fd The file descriptor.
+*   @return NULL on failure or a pointer to a json writer on success.
+*/
+json_writer_t* json_writer_fd(int fd);
+#endif
+
+/** @brief Create a json writer that writes to a growing memory buffer, see json_writer_get_buffer().
+*   @return NULL on failure or a pointer to a json writer on success.
+*/
+json_writer_t* json_writer_memory(void);
+
+/** @brief Get the output of a writer created with json_writer_memory().
+*   @param writer Pointer to a json writer.
+*   @param size Set to the number of bytes written.
+*   @return The output, valid until the next write or json_writer_close().
+*/
+const char* json_writer_get_buffer(json_writer_t* writer, size_t* size);
+
+/** @brief Write the buffered output to the sink.
+*   @param writer Pointer to a json writer.
+*   @return 0 on success, -1 if a write has failed.
+*/
+int json_writer_flush(json_writer_t* writer);
+
+/** @brief Flush, close the sink and free memory for the json writer.
+*   @param writer Pointer to a json writer.
+*   @return 0 on success, -1 if a write has failed.
+*/
+int json_writer_close(json_writer_t* writer);
+
+/** @brief Write the start or end of an object or an array.
+*   @param writer Pointer to a json writer.
+*/
+void json_write_start_object(json_writer_t* writer);
+void json_write_end_object(json_writer_t* writer);
+void json_write_start_array(json_writer_t* writer);
+void json_write_end_array(json_writer_t* writer);
+
+/** @brief Write the name of the next member of an object.
+*   @param writer Pointer to a json writer.
+*   @param name The name, UTF-8, it is escaped.
+*   @param len The length of the name in bytes.
+*/
+void json_write_name(json_writer_t* writer, const char* name);
+void json_write_name_n(json_writer_t* writer, const char* name, size_t len);
+
+/** @brief Write a string value.
+*   @param writer Pointer to a json writer.
+*   @param str The string, UTF-8, it is escaped.
+*   @param len The length of the string in bytes.
+*/
+void json_write_string(json_writer_t* writer, const char* str);
+void json_write_string_n(json_writer_t* writer, const char* str, size_t len);
+
+/** @brief Write a number, boolean or null value. Doubles are written with the shortest
+*   representation that reads back to the same value, NaN and infinity are written as null.
+*   @param writer Pointer to a json writer.
+*   @param value The value.
+*/
+void json_write_int64(json_writer_t* writer, int64_t value);
+void json_write_uint64(json_writer_t* writer, uint64_t value);
+void json_write_double(json_writer_t* writer, double value);
+void json_write_boolean(json_writer_t* writer, int value);
+void json_write_null(json_writer_t* writer);
+
+/** @brief Write a value that is already valid json text, it is copied as is.
+*   @param writer Pointer to a json writer.
+*   @param json The json text.
+*   @param len The length of the json text in bytes.
+*/
+void json_write_raw(json_writer_t* writer, const char* json, size_t len);
+
+/** @brief Write each member and element on its own line, indented by indent spaces per level. 0 is compact.
+*   @param writer Pointer to a json writer.
+*   @param indent Number of spaces.
+*/
+void json_writer_set_indent(json_writer_t* writer, int indent);
+
+/** @brief Copy a json document from a tokenizer to a writer without whitespace.
+*
+*   The input is validated with the same rules as json_next_token(), strings and numbers are
+*   copied verbatim without being decoded. Memory use is bounded by the largest string. With a
+*   schema (see json_set_schema()) names and strings are decoded, validated and escaped again.
+*
+*   @param src Pointer to a json structure, no tokens should have been read.
+*   @param dst Pointer to a json writer.
+*   @return JSON_END_DOCUMENT on success, JSON_ERROR on invalid input (see json_get_error()) or a failed
+*           write (see json_writer_flush()), JSON_WOULD_BLOCK if the input would block, call it again to continue.
+*/
+json_token_t json_minify(json_t* src, json_writer_t* dst);
+
+/** @brief Like json_minify() but with json_writer_set_indent(dst, indent).
+*/
+json_token_t json_pretty(json_t* src, json_writer_t* dst, int indent);
+
+/** @brief Read the object or array that was just started and return its source text.
+*
+*   Call it right after json_next_token() returned JSON_START_OBJECT or JSON_START_ARRAY. The
+*   container is validated like json_next_token() does but not decoded, and the next call of
+*   json_next_token() continues after it. The text is not copied, it points into the input
+*   buffer, or into the data of json_open_memory(), and is valid until json_next_token() is
+*   called again. A file or a reader keeps the whole container in the input buffer.
+*
+*   @param json Pointer to a json structure.
+*   @param raw Set to the first byte of the container, the '{' or '['.
+*   @param len Set to the length of the container in bytes, up to and including the '}' or ']'.
+*   @return JSON_END_OBJECT or JSON_END_ARRAY on success, JSON_ERROR on invalid input (see json_get_error())
+*           or if no container was started, JSON_WOULD_BLOCK if the input would block, call it again to continue.
+*/
+json_token_t json_capture_raw(json_t* json, const char** raw, size_t* len);
+
 #ifdef JSON_TOKENIZER_IMPLEMENTATION
 
 #if defined(_REALLOC) && !defined(JSON_FREE) || !defined(JSON_REALLOC) && defined(JSON_FREE)
@@ -136,35 +606,174 @@ const char* json_get_error(json_t* json);
 #endif
 #define JSON_FGETC(fp) fgetc(fp)
 #define JSON_FCLOSE(fp) fclose(fp)
+#define JSON_FREAD(fp,buf,size) fread(buf,1,size,fp)
+#if defined(_MSC_VER)
+#define JSON_FSEEK(fp,offset) _fseeki64(fp,(__int64)(offset),SEEK_SET)
+#elif defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200112L || defined(__APPLE__)
+#define JSON_FSEEK(fp,offset) fseeko(fp,(off_t)(offset),SEEK_SET)
+#else
+#define JSON_FSEEK(fp,offset) fseek(fp,(long)(offset),SEEK_SET)
+#endif
+#endif
+
+#ifndef JSON_FREAD
+#define JSON_FREAD(fp,buf,size) json__fread_fgetc(fp,buf,size)
+static size_t json__fread_fgetc(FILE* fp, void* buf, size_t size)
+{
+	size_t i = 0;
+	int ch;
+	while (i < size && (ch = JSON_FGETC(fp)) != EOF) ((uint8_t*)buf)[i++] = (uint8_t)ch;
+	return i;
+}
+#endif
+
+#ifndef JSON_BUFFER_SIZE
+#define JSON_BUFFER_SIZE (65536)
+#endif
+
+#ifdef JSON_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef JSON_ZSTD
+#include <zstd.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef JSON_READAHEAD
+#include <pthread.h>
+#endif
 #endif
 
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+
 #define STACK_SIZE (4096)
 #define MAX_NESTING_LEVEL (20)
-#define LABEL(addr) do{case addr:;}while(0);
-#define JMP(addr) do{json->lc=addr;goto jp;}while(0)
-#define CALL(ret_addr,call_addr) do{{enum json__label ret=ret_addr; json->lc=call_addr;json__push(json,&ret,sizeof(enum json__label));}goto jp;case ret_addr:;}while(0)
-#define RET() do{json->lc=*(enum json__label*)json__pop(json, sizeof(enum json__label));goto jp;}while(0);
-#define TOK(addr,tok) do{json->lc=addr;return tok;case addr:;}while(0)
+// The labels of the state machine: routines, returns from calls (c), tokens (t) and reads that may suspend (g).
+#define JSON__LABELS(X) \
+	X(json__start) X(json__error) X(json__error_loop) X(json__padding) X(json__object) X(json__array) X(json__array_l1) \
+	X(json__array_l2) X(json__object_l1) X(json__object_l2) X(json__string) X(json__element) X(json__null) X(json__true) \
+	X(json__false) X(json__number) X(json__number_l1) X(json__number_l2) X(json__c1) X(json__c2) X(json__c3) \
+	X(json__c5) X(json__c6) X(json__c7) X(json__c8) X(json__c9) X(json__c10) X(json__c11) X(json__c12) X(json__c13) \
+	X(json__c14) X(json__c15) X(json__c17) X(json__c18) X(json__t1) X(json__t2) X(json__t3) X(json__t4) \
+	X(json__t5) X(json__t6) X(json__t7) X(json__t8) X(json__t9) X(json__t11) X(json__t12) X(json__t13) \
+	X(json__t14) X(json__g1) X(json__g2) X(json__g3) X(json__g4) X(json__g5) X(json__g6) X(json__g7) X(json__g8) \
+	X(json__g9) X(json__g10) X(json__g11) X(json__g12) X(json__g13) X(json__g14) X(json__g15) X(json__g16) X(json__g17) \
+	X(json__g18) X(json__g19) X(json__g20) X(json__g21) X(json__g22) X(json__g23) X(json__g24) X(json__g25) X(json__g26) \
+	X(json__g27) X(json__g28) X(json__resume) X(json__schema_error) X(json__document) X(json__end_document)
+#define JSON__LABEL_ENUM(name) name,
+#define JSON__LABEL_ADDRESS(name) &&name,
 
 enum json__label {
-	json__start, json__error, json__error_loop, json__padding, json__object, json__array, json__array_l1, json__array_l2, json__object_l1,
-	json__object_l2, json__string, json__element, json__null, json__true, json__false, json__number, json__number_l1, json__number_l2,
-	json__c1, json__c2, json__c3, json__c4, json__c5, json__c6, json__c7, json__c8, json__c9, json__c10, json__c11, json__c12, json__c13, json__c14,
-	json__c15, json__c16, json__c17, json__c18, json__t1, json__t2, json__t3, json__t4, json__t5, json__t6, json__t7, json__t8, json__t9, json__t10,
-	json__t11, json__t12, json__t13, json__t14
+	JSON__LABELS(JSON__LABEL_ENUM)
+	json__label_count
 };
 
+#if defined(JSON_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+// Direct threaded dispatch: jumps and calls go straight to their label, returns and resuming
+// after a token go through a table of label addresses.
+#define JSON__THREADED
+#define LABEL(addr) addr:;
+#define JMP(addr) goto addr
+#define CALL(ret_addr,call_addr) do{json->calls[json->call_depth++]=(uint8_t)ret_addr;goto call_addr;ret_addr:;}while(0)
+#define RET() goto *json__dispatch[json->calls[--json->call_depth]]
+#define TOK(addr,tok) do{json->lc=addr;if(json->schema!=NULL&&!json__validate(json,tok))goto json__schema_error;return tok;addr:;}while(0)
+#define GETC(addr) do{if(json->buf_pos==json->buf_end){addr:if(!json__fill(json)&&json->input==JSON__INPUT_AGAIN){json->lc=addr;return JSON_WOULD_BLOCK;}}json__getc(json);}while(0)
+#else
+#define LABEL(addr) do{case addr:;}while(0);
+#define JMP(addr) do{json->lc=addr;goto jp;}while(0)
+#define CALL(ret_addr,call_addr) do{json->calls[json->call_depth++]=(uint8_t)ret_addr;json->lc=call_addr;goto jp;case ret_addr:;}while(0)
+#define RET() do{json->lc=(enum json__label)json->calls[--json->call_depth];goto jp;}while(0)
+#define TOK(addr,tok) do{json->lc=addr;if(json->schema!=NULL&&!json__validate(json,tok))JMP(json__schema_error);return tok;case addr:;}while(0)
+#define GETC(addr) do{if(json->buf_pos==json->buf_end){case addr:if(!json__fill(json)&&json->input==JSON__INPUT_AGAIN){json->lc=addr;return JSON_WOULD_BLOCK;}}json__getc(json);}while(0)
+#endif
+
 enum json__number_type {
 	JSON__NUMBER_INT64, JSON__NUMBER_UINT64, JSON__NUMBER_DOUBLE
 };
 
+enum json__input {
+	JSON__INPUT_OK, JSON__INPUT_END, JSON__INPUT_ERROR, JSON__INPUT_AGAIN
+};
+
+#define JSON__SCHEMA_NONE (0xFFFFFFFFu)
+
+enum json__schema_type {
+	JSON__TYPE_OBJECT = 1, JSON__TYPE_ARRAY = 2, JSON__TYPE_STRING = 4, JSON__TYPE_INTEGER = 8, JSON__TYPE_NUMBER = 16,
+	JSON__TYPE_BOOLEAN = 32, JSON__TYPE_NULL = 64
+};
+
+enum json__schema_flag {
+	JSON__SCHEMA_MINIMUM = 1, JSON__SCHEMA_MAXIMUM = 2, JSON__SCHEMA_EXCLUSIVE_MINIMUM = 4, JSON__SCHEMA_EXCLUSIVE_MAXIMUM = 8,
+	JSON__SCHEMA_MIN_LENGTH = 16, JSON__SCHEMA_MAX_LENGTH = 32, JSON__SCHEMA_MIN_ITEMS = 64, JSON__SCHEMA_MAX_ITEMS = 128,
+	JSON__SCHEMA_CLOSED = 256
+};
+
+enum json__schema_violation {
+	JSON__VIOLATION_TYPE, JSON__VIOLATION_MINIMUM, JSON__VIOLATION_MAXIMUM, JSON__VIOLATION_MIN_LENGTH, JSON__VIOLATION_MAX_LENGTH,
+	JSON__VIOLATION_MIN_ITEMS, JSON__VIOLATION_MAX_ITEMS, JSON__VIOLATION_UNKNOWN_KEY, JSON__VIOLATION_REQUIRED
+};
+
+// Node 0 accepts anything, node 1 is the root. Types 0 is any type.
+struct json__schema_node {
+	uint32_t types, flags, first_property, items;
+	uint64_t required_mask;
+	double minimum, maximum, exclusive_minimum, exclusive_maximum;
+	uint64_t min_length, max_length, min_items, max_items;
+};
+
+// The properties of a node is a linked list, name is an offset into json__schema.names.
+struct json__schema_property {
+	uint32_t name, name_length, hash, node, next;
+	uint64_t required_bit;
+};
+
+struct json__schema {
+	struct json__schema_node* nodes;
+	struct json__schema_property* properties;
+	char* names;
+	size_t node_count, node_capacity, property_count, property_capacity, names_size, names_capacity;
+};
+
+// The validation state of an open object or array, json->schema_stack is indexed by json->level.
+struct json__schema_frame {
+	uint32_t node, key;
+	int array;
+	uint64_t seen, count;
+};
+
 struct json__impl {
-	FILE* fp;
+	json_reader_t reader;
 	enum json__label lc;
 	enum json__number_type number_type;
-	int ch, ra, rb, rc, row, col, sc, level;
+	enum json__input input;
+	int ch, rd, re, level, call_depth;
+	uint8_t calls[2 * MAX_NESTING_LEVEL + 8];
+	size_t ra, rb, sc;
+	int64_t row, col, tok_row, tok_col;
+	uint64_t offset, tok_offset;
+	int stream;
+	const json_schema_t* schema;
+	enum json__schema_violation violation;
+	int violation_depth;
+	uint32_t violation_arg;
+	struct json__schema_frame schema_stack[MAX_NESTING_LEVEL + 2];
 	size_t stack_capacity;
 	uint8_t* stack;
+	size_t buf_capacity;
+	uint8_t* buf;
+	const uint8_t* buf_pos;
+	const uint8_t* buf_end;
+	const uint8_t* mark;
+	size_t span_len;
+	int raw;
+	const uint8_t* capture;
+	int capture_level;
 };
 
 const char json__error_unexpected_end_of_file[] = "Error: Unexpected end of file.";
@@ -176,6 +785,7 @@ static void json__push(json_t* json, const void* data, size_t size)
 {
 	if ((json->sc + size) > json->stack_capacity) {
 		size_t new_capacity = json->stack_capacity * 2;
+		while (json->sc + size > new_capacity) new_capacity *= 2;
 		uint8_t* new_stack = (uint8_t*)JSON_REALLOC(NULL, json->stack, new_capacity);
 		if (new_stack == NULL) {
 			fprintf(stderr, "PANIC failed to allocate memory for json_t stack!");
@@ -183,28 +793,16 @@ static void json__push(json_t* json, const void* data, size_t size)
 		}
 		json->stack = new_stack;
 		json->stack_capacity = new_capacity;
-		}
-	for (size_t i = 0; i < size; i++) {
-		json->stack[json->sc++] = ((uint8_t*)data)[i];
 	}
+	memcpy(json->stack + json->sc, data, size);
+	json->sc += size;
 }
 
-static const void* json__pop(json_t* json, size_t size)
-{
-	json->sc -= (int)size;
-	return &(json->stack[json->sc]);
-}
 static const void* json__peek(json_t* json, size_t size, size_t index)
 {
 	return &(json->stack[json->sc - size - index]);
 }
 
-static const char* json__peek_str(json_t* json)
-{
-	int size = *((int*)&json->stack[json->sc - sizeof(int) - sizeof(uint8_t)]);
-	return (const char*)(json->stack + json->sc - sizeof(int) - size - sizeof(uint8_t));
-}
-
 static const char* json__pop_str(json_t* json) {
 	int size = *((int*)&json->stack[json->sc - sizeof(int) - sizeof(uint8_t)]);
 	const char* str = (const char*)(json->stack + json->sc - sizeof(int) - size - sizeof(uint8_t));
@@ -217,16 +815,17 @@ static size_t json__strlen(const char* str) {
 	return n - str;
 }
 
-static char* json__itoa(char* buf, size_t bufsize, int val, int base)
+static char* json__itoa(char* buf, size_t bufsize, int64_t val, int base)
 {
 	size_t i = bufsize - 2;
 	buf[bufsize - 1] = '\0';
 
-	for (; val && i; --i, val /= base) {
+	do {
 		buf[i] = "0123456789abcdef"[val % base];
-	}
+		val /= base;
+	} while (val && --i);
 
-	return &buf[i + 1];
+	return &buf[i];
 }
 
 static void json__push_str(json_t* json, const char* str, uint8_t postfix) {
@@ -237,18 +836,54 @@ static void json__push_str(json_t* json, const char* str, uint8_t postfix) {
 	json__push(json, &postfix, sizeof(uint8_t));
 }
 
-static int json__strncmp(const char* a, const char* b, size_t n)
+// Read more input, the bytes from json->mark or json->capture and on are kept and moved to the start of the buffer.
+// Otherwise the last byte is kept, so the '[' of a JSON_START_ARRAY is still there for json_capture_raw().
+static int json__fill(json_t* json)
 {
-	while (n && *a && (*a == *b)) {
-		++a; ++b; n--;
+	const uint8_t* keep_from = json->buf_end;
+	size_t keep;
+	if (json->reader.read == NULL) { // Memory input
+		json->input = JSON__INPUT_END;
+		return 0;
+	}
+	if (json->mark != NULL) keep_from = json->mark;
+	if (json->capture != NULL && json->capture < keep_from) keep_from = json->capture;
+	if (keep_from == json->buf_end && json->buf_end != json->buf) keep_from--;
+	keep = (size_t)(json->buf_end - keep_from);
+	if (keep > 0) {
+		size_t mark = json->mark != NULL ? (size_t)(json->mark - keep_from) : 0;
+		size_t capture = json->capture != NULL ? (size_t)(json->capture - keep_from) : 0;
+		if (keep == json->buf_capacity) {
+			size_t new_capacity = json->buf_capacity * 2;
+			uint8_t* new_buf = (uint8_t*)JSON_REALLOC(NULL, json->buf, new_capacity);
+			if (new_buf == NULL) {
+				fprintf(stderr, "PANIC failed to allocate memory for json_t buffer!");
+				exit(-1);
+			}
+			json->buf = new_buf;
+			json->buf_capacity = new_capacity;
+		}
+		else if (keep_from != json->buf) memmove(json->buf, keep_from, keep);
+		if (json->mark != NULL) json->mark = json->buf + mark;
+		if (json->capture != NULL) json->capture = json->buf + capture;
+	}
+	json->buf_pos = json->buf + keep;
+	json->buf_end = json->buf + keep;
+
+	intptr_t n = json->reader.read(json->reader.user, json->buf + keep, json->buf_capacity - keep);
+	if (n > 0) {
+		json->buf_end = json->buf + keep + n;
+		json->offset += (uint64_t)n;
+		json->input = JSON__INPUT_OK;
+		return 1;
 	}
-	if (n == 0) return 0;
-	else return (*(uint8_t*)a - *(uint8_t*)b);
+	json->input = n == 0 ? JSON__INPUT_END : n == JSON_READ_AGAIN ? JSON__INPUT_AGAIN : JSON__INPUT_ERROR;
+	return 0;
 }
 
 static int json__getc(json_t* json)
 {
-	int ch = fgetc(json->fp);
+	int ch = json->buf_pos < json->buf_end ? *json->buf_pos++ : EOF;
 	if (ch == '\n') {
 		json->row++;
 		json->col = 1;
@@ -260,6 +895,14 @@ static int json__getc(json_t* json)
 	return ch != EOF;
 }
 
+// Record the position of json->ch, the first character of the next token.
+static void json__mark_token(json_t* json)
+{
+	json->tok_offset = json->offset - (uint64_t)(json->buf_end - json->buf_pos) - (json->ch != EOF);
+	json->tok_row = json->row;
+	json->tok_col = json->col;
+}
+
 int json__hex_to_int(int ch)
 {
 	if (ch >= '0' && ch <= '9') return (ch - '0');
@@ -268,13 +911,8 @@ int json__hex_to_int(int ch)
 	else return 0;
 }
 
-void json__push_hex(json_t* json, const int* const hex)
+void json__push_utf8(json_t* json, int unicode)
 {
-	int unicode = json__hex_to_int(hex[0]) << 12;
-	unicode += json__hex_to_int(hex[1]) << 8;
-	unicode += json__hex_to_int(hex[2]) << 4;
-	unicode += json__hex_to_int(hex[3]);
-
 	if (unicode >= 0 && unicode <= 0x7f) { // 7F(16) = 127(10)
 		uint8_t ch = (uint8_t)unicode;
 		json__push(json, &ch, sizeof(uint8_t));
@@ -302,84 +940,923 @@ void json__push_hex(json_t* json, const int* const hex)
 	}
 }
 
-json_t* json_fopen(const char* filename)
+// The state at the start of a document, the buffers, the schema and the stream setting are left as they are.
+static void json__reset(json_t* json)
 {
-	FILE* fp = NULL;
-
-	if (JSON_FOPEN(fp, filename, "r") != 0) {
-		return NULL;
-	}
+	json->lc = json__start;
+	json->input = JSON__INPUT_OK;
+	json->col = 1;
+	json->row = 1;
+	json->sc = 0;
+	json->level = 0;
+	json->call_depth = 0;
+	json->buf_pos = json->buf;
+	json->buf_end = json->buf;
+	json->mark = NULL;
+	json->span_len = 0;
+	json->raw = 0;
+	json->capture = NULL;
+	json->capture_level = 0;
+	json->offset = 0;
+	json->tok_offset = 0;
+	json->tok_row = 1;
+	json->tok_col = 1;
+}
 
+json_t* json_open_reader(const json_reader_t* reader)
+{
 	json_t* json = (json_t*)JSON_REALLOC(NULL, NULL, sizeof(json_t));
 	if(json == NULL) {
-		fprintf(stderr, "PANIC: Failed to allocate memory for svg structure.");
+		fprintf(stderr, "PANIC: Failed to allocate memory for json structure.");
 		exit(-1);
 	}
 
-	json->stack = (uint8_t*)calloc(STACK_SIZE, sizeof(uint8_t));
-	if (json->stack == NULL) {
-		fprintf(stderr, "PANIC: Failed to allocate memory for svg stack.");
+	json->stack = (uint8_t*)JSON_REALLOC(NULL, NULL, STACK_SIZE);
+	json->buf = reader->read != NULL ? (uint8_t*)JSON_REALLOC(NULL, NULL, JSON_BUFFER_SIZE) : NULL;
+	if (json->stack == NULL || (json->buf == NULL && reader->read != NULL)) {
+		fprintf(stderr, "PANIC: Failed to allocate memory for json stack.");
 		exit(-1);
 	}
 
-	json->lc = json__start;
-	json->col = 1;
-	json->row = 1;
-	json->sc = 0;
-	json->fp = fp;
-	json->level = 0;
+	json->reader = *reader;
 	json->stack_capacity = STACK_SIZE;
+	json->buf_capacity = JSON_BUFFER_SIZE;
+	json->stream = 0;
+	json->schema = NULL;
+	json__reset(json);
 
 	return json;
 }
 
-json_token_t json_next_token(json_t* json)
+void json_reopen(json_t* json, const json_reader_t* reader)
 {
-	int sc, len;
-	uint8_t ch, n, postfix, pf, comma;
-	char buf[32];
-jp: switch (json->lc) {
-	LABEL(json__start);
-	if (!json__getc(json)) JMP(json__error);
-	if (json->ch == 0xEF) for (int i = 0; i < 3; i++) { // Ignore BOM
-		if(!json__getc(json)) JMP(json__error);
+	if (json->reader.close != NULL) json->reader.close(json->reader.user);
+	if (json->buf == NULL && reader->read != NULL) { // Memory input has no buffer
+		json->buf = (uint8_t*)JSON_REALLOC(NULL, NULL, JSON_BUFFER_SIZE);
+		if (json->buf == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for json buffer.");
+			exit(-1);
+		}
+		json->buf_capacity = JSON_BUFFER_SIZE;
 	}
-	json->col = 1;
-	json->level = 1;
-	CALL(json__c1, json__padding);
-	if (json->ch == '{') CALL(json__c2, json__object);
-	else if (json->ch == '[') CALL(json__c3, json__array);
-	else JMP(json__error);
-	json__getc(json);
-	CALL(json__c18, json__padding);
-	if (!feof(json->fp)) JMP(json__error);
-	for (;;) TOK(json__t1, JSON_END_DOCUMENT);
+	json->reader = *reader;
+	json__reset(json);
+}
 
-	LABEL(json__padding);
-	while (json->ch == ' ' || json->ch == '\r' || json->ch == '\n' || json->ch == '\t' || json->ch == '\f') {
-		json__getc(json);
-	}
-	RET();
+json_t* json_open_memory(const void* data, size_t size)
+{
+	json_reader_t reader = { NULL, NULL, NULL, NULL };
+	json_t* json = json_open_reader(&reader);
+	json->buf_pos = (const uint8_t*)data;
+	json->buf_end = (const uint8_t*)data + size;
+	json->offset = size;
+	return json;
+}
 
-	LABEL(json__element);
-	if (json->ch == '\"') {
-		sc = json->sc;
-		n = '\0';
-		postfix = 's';
-		CALL(json__c12, json__string);
+static intptr_t json__file_read(void* user, void* buf, size_t size)
+{
+	FILE* fp = (FILE*)user;
+	size_t n = JSON_FREAD(fp, buf, size);
+	if (n == 0 && ferror(fp)) return JSON_READ_ERROR;
+	return (intptr_t)n;
+}
+
+static void json__file_close(void* user)
+{
+	FILE* fp = (FILE*)user;
+	JSON_FCLOSE(fp);
+}
+
+#ifdef JSON_FSEEK
+static int json__file_seek(void* user, uint64_t offset)
+{
+	FILE* fp = (FILE*)user;
+	return JSON_FSEEK(fp, offset) == 0 ? 0 : -1;
+}
+#define JSON__FILE_SEEK json__file_seek
+#else
+#define JSON__FILE_SEEK NULL
+#endif
+
+int json_file_reader(json_reader_t* reader, const char* filename)
+{
+	FILE* fp = NULL;
+
+	if (JSON_FOPEN(fp, filename, "rb") != 0) {
+		return -1;
+	}
+
+	reader->read = json__file_read;
+	reader->close = json__file_close;
+	reader->user = fp;
+	reader->seek = JSON__FILE_SEEK;
+	return 0;
+}
+
+json_t* json_fopen(const char* filename)
+{
+	FILE* fp = NULL;
+
+	if (JSON_FOPEN(fp, filename, "rb") != 0) {
+		return NULL;
+	}
+
+	json_reader_t reader = { json__file_read, json__file_close, fp, JSON__FILE_SEEK };
+	return json_open_reader(&reader);
+}
+
+#ifdef JSON_ZLIB
+struct json__inflate {
+	json_reader_t source;
+	z_stream zs;
+	int end, stream_end;
+	uint8_t in[JSON_BUFFER_SIZE];
+};
+
+static intptr_t json__inflate_read(void* user, void* buf, size_t size)
+{
+	struct json__inflate* z = (struct json__inflate*)user;
+	if (size > (uInt)-1) size = (uInt)-1;
+	z->zs.next_out = (Bytef*)buf;
+	z->zs.avail_out = (uInt)size;
+	for (;;) {
+		if (z->zs.avail_in == 0 && !z->end) {
+			intptr_t n = z->source.read(z->source.user, z->in, sizeof(z->in));
+			if (n < 0) return z->zs.avail_out < size ? (intptr_t)(size - z->zs.avail_out) : n;
+			if (n == 0) z->end = 1;
+			z->zs.next_in = z->in;
+			z->zs.avail_in = (uInt)n;
+		}
+		int ret = inflate(&z->zs, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END) {
+			// The next gzip member, if any, starts after the end of this one.
+			z->stream_end = 1;
+			inflateReset(&z->zs);
+		}
+		else if (ret == Z_OK) z->stream_end = 0;
+		else if (ret != Z_BUF_ERROR) return JSON_READ_ERROR;
+
+		size_t produced = size - z->zs.avail_out;
+		if (z->zs.avail_out == 0) return (intptr_t)produced;
+		if (z->zs.avail_in == 0) {
+			if (produced > 0) return (intptr_t)produced;
+			if (z->end) return z->stream_end ? 0 : JSON_READ_ERROR;
+		}
+	}
+}
+
+static void json__inflate_close(void* user)
+{
+	struct json__inflate* z = (struct json__inflate*)user;
+	inflateEnd(&z->zs);
+	if (z->source.close != NULL) z->source.close(z->source.user);
+	JSON_FREE(NULL, z);
+}
+
+int json_inflate(json_reader_t* reader)
+{
+	struct json__inflate* z = (struct json__inflate*)JSON_REALLOC(NULL, NULL, sizeof(struct json__inflate));
+	if (z == NULL) return -1;
+	z->source = *reader;
+	z->end = 0;
+	z->stream_end = 0;
+	z->zs.zalloc = Z_NULL;
+	z->zs.zfree = Z_NULL;
+	z->zs.opaque = Z_NULL;
+	z->zs.next_in = z->in;
+	z->zs.avail_in = 0;
+	if (inflateInit2(&z->zs, 15 + 32) != Z_OK) { // Detect gzip or zlib header
+		JSON_FREE(NULL, z);
+		return -1;
+	}
+
+	reader->read = json__inflate_read;
+	reader->close = json__inflate_close;
+	reader->user = z;
+	reader->seek = NULL;
+	return 0;
+}
+#endif
+
+#ifdef JSON_ZSTD
+struct json__zstd {
+	json_reader_t source;
+	ZSTD_DStream* ds;
+	ZSTD_inBuffer input;
+	int end, frame_end;
+	uint8_t in[JSON_BUFFER_SIZE];
+};
+
+static intptr_t json__zstd_read(void* user, void* buf, size_t size)
+{
+	struct json__zstd* z = (struct json__zstd*)user;
+	ZSTD_outBuffer output = { buf, size, 0 };
+	for (;;) {
+		if (z->input.pos == z->input.size && !z->end) {
+			intptr_t n = z->source.read(z->source.user, z->in, sizeof(z->in));
+			if (n < 0) return output.pos > 0 ? (intptr_t)output.pos : n;
+			if (n == 0) z->end = 1;
+			z->input.src = z->in;
+			z->input.size = (size_t)n;
+			z->input.pos = 0;
+		}
+		size_t ret = ZSTD_decompressStream(z->ds, &output, &z->input);
+		if (ZSTD_isError(ret)) return JSON_READ_ERROR;
+		z->frame_end = ret == 0;
+
+		if (output.pos == output.size) return (intptr_t)output.pos;
+		if (z->input.pos == z->input.size) {
+			if (output.pos > 0) return (intptr_t)output.pos;
+			if (z->end) return z->frame_end ? 0 : JSON_READ_ERROR;
+		}
+	}
+}
+
+static void json__zstd_close(void* user)
+{
+	struct json__zstd* z = (struct json__zstd*)user;
+	ZSTD_freeDStream(z->ds);
+	if (z->source.close != NULL) z->source.close(z->source.user);
+	JSON_FREE(NULL, z);
+}
+
+int json_zstd(json_reader_t* reader)
+{
+	struct json__zstd* z = (struct json__zstd*)JSON_REALLOC(NULL, NULL, sizeof(struct json__zstd));
+	if (z == NULL) return -1;
+	z->ds = ZSTD_createDStream();
+	if (z->ds == NULL || ZSTD_isError(ZSTD_initDStream(z->ds))) {
+		ZSTD_freeDStream(z->ds);
+		JSON_FREE(NULL, z);
+		return -1;
+	}
+	z->source = *reader;
+	z->input.src = z->in;
+	z->input.size = 0;
+	z->input.pos = 0;
+	z->end = 0;
+	z->frame_end = 0;
+
+	reader->read = json__zstd_read;
+	reader->close = json__zstd_close;
+	reader->user = z;
+	reader->seek = NULL;
+	return 0;
+}
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+static intptr_t json__fd_read(void* user, void* buf, size_t size)
+{
+	for (;;) {
+		ssize_t n = read((int)(intptr_t)user, buf, size);
+		if (n >= 0) return (intptr_t)n;
+		if (errno == EAGAIN || errno == EWOULDBLOCK) return JSON_READ_AGAIN;
+		if (errno != EINTR) return JSON_READ_ERROR;
+	}
+}
+
+static int json__fd_seek(void* user, uint64_t offset)
+{
+	return lseek((int)(intptr_t)user, (off_t)offset, SEEK_SET) == (off_t)-1 ? -1 : 0;
+}
+
+json_t* json_open_fd(int fd)
+{
+	json_reader_t reader = { json__fd_read, NULL, (void*)(intptr_t)fd, json__fd_seek };
+	return json_open_reader(&reader);
+}
+
+#ifdef JSON_READAHEAD
+struct json__readahead {
+	json_reader_t source;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int count, head, filled, stop;
+	size_t size, pos;
+	intptr_t* length;
+	uint8_t* data;
+};
+
+// The helper thread fills the buffer after the last filled one until the source ends.
+static void* json__readahead_thread(void* user)
+{
+	struct json__readahead* ra = (struct json__readahead*)user;
+	intptr_t n = 0;
+	do {
+		pthread_mutex_lock(&ra->mutex);
+		while (ra->filled == ra->count && !ra->stop) pthread_cond_wait(&ra->cond, &ra->mutex);
+		int slot = (ra->head + ra->filled) % ra->count;
+		int stop = ra->stop;
+		pthread_mutex_unlock(&ra->mutex);
+		if (stop) break;
+
+		n = ra->source.read(ra->source.user, ra->data + slot * ra->size, ra->size);
+		if (n == JSON_READ_AGAIN) n = JSON_READ_ERROR;
+
+		pthread_mutex_lock(&ra->mutex);
+		ra->length[slot] = n;
+		ra->filled++;
+		pthread_cond_broadcast(&ra->cond);
+		pthread_mutex_unlock(&ra->mutex);
+	} while (n > 0);
+	return NULL;
+}
+
+static intptr_t json__readahead_read(void* user, void* buf, size_t size)
+{
+	struct json__readahead* ra = (struct json__readahead*)user;
+	pthread_mutex_lock(&ra->mutex);
+	while (ra->filled == 0) pthread_cond_wait(&ra->cond, &ra->mutex);
+	int slot = ra->head;
+	pthread_mutex_unlock(&ra->mutex);
+
+	// The end of the input and errors stay in the buffer and are returned by every following read.
+	intptr_t n = ra->length[slot];
+	if (n <= 0) return n;
+	if (size > (size_t)n - ra->pos) size = (size_t)n - ra->pos;
+	memcpy(buf, ra->data + slot * ra->size + ra->pos, size);
+	ra->pos += size;
+
+	if (ra->pos == (size_t)n) {
+		ra->pos = 0;
+		pthread_mutex_lock(&ra->mutex);
+		ra->head = (ra->head + 1) % ra->count;
+		ra->filled--;
+		pthread_cond_broadcast(&ra->cond);
+		pthread_mutex_unlock(&ra->mutex);
+	}
+	return (intptr_t)size;
+}
+
+static void json__readahead_close(void* user)
+{
+	struct json__readahead* ra = (struct json__readahead*)user;
+	pthread_mutex_lock(&ra->mutex);
+	ra->stop = 1;
+	pthread_cond_broadcast(&ra->cond);
+	pthread_mutex_unlock(&ra->mutex);
+	pthread_join(ra->thread, NULL);
+	pthread_cond_destroy(&ra->cond);
+	pthread_mutex_destroy(&ra->mutex);
+	if (ra->source.close != NULL) ra->source.close(ra->source.user);
+	JSON_FREE(NULL, ra->data);
+	JSON_FREE(NULL, ra->length);
+	JSON_FREE(NULL, ra);
+}
+
+int json_readahead(json_reader_t* reader, int count, size_t size)
+{
+	if (count < 2 || size == 0) return -1;
+
+	struct json__readahead* ra = (struct json__readahead*)JSON_REALLOC(NULL, NULL, sizeof(struct json__readahead));
+	if (ra == NULL) return -1;
+	ra->source = *reader;
+	ra->count = count;
+	ra->head = 0;
+	ra->filled = 0;
+	ra->stop = 0;
+	ra->size = size;
+	ra->pos = 0;
+	ra->length = (intptr_t*)JSON_REALLOC(NULL, NULL, count * sizeof(intptr_t));
+	ra->data = (uint8_t*)JSON_REALLOC(NULL, NULL, count * size);
+	if (ra->length == NULL || ra->data == NULL) {
+		JSON_FREE(NULL, ra->length);
+		JSON_FREE(NULL, ra->data);
+		JSON_FREE(NULL, ra);
+		return -1;
+	}
+
+	pthread_mutex_init(&ra->mutex, NULL);
+	pthread_cond_init(&ra->cond, NULL);
+	if (pthread_create(&ra->thread, NULL, json__readahead_thread, ra) != 0) {
+		pthread_cond_destroy(&ra->cond);
+		pthread_mutex_destroy(&ra->mutex);
+		JSON_FREE(NULL, ra->length);
+		JSON_FREE(NULL, ra->data);
+		JSON_FREE(NULL, ra);
+		return -1;
+	}
+
+	reader->read = json__readahead_read;
+	reader->close = json__readahead_close;
+	reader->user = ra;
+	reader->seek = NULL;
+	return 0;
+}
+
+json_t* json_fopen_readahead(const char* filename, int count, size_t size)
+{
+	FILE* fp = NULL;
+
+	if (JSON_FOPEN(fp, filename, "rb") != 0) {
+		return NULL;
+	}
+
+	json_reader_t reader = { json__file_read, json__file_close, fp, JSON__FILE_SEEK };
+	if (json_readahead(&reader, count, size) != 0) {
+		JSON_FCLOSE(fp);
+		return NULL;
+	}
+	return json_open_reader(&reader);
+}
+#endif
+#endif
+
+// Convert a json number to the nearest double. strtod() rounds correctly but reads the decimal point of
+// the locale, so the '.' is replaced with it first. The schema and the document use the same conversion.
+static double json__parse_double(const char* str)
+{
+	const char* dot = strchr(str, '.');
+	const char* point = localeconv()->decimal_point;
+	if (dot == NULL || strcmp(point, ".") == 0) return strtod(str, NULL);
+
+	char buf[64];
+	size_t len = strlen(str), point_len = strlen(point), size = len + point_len;
+	char* copy = size <= sizeof(buf) ? buf : (char*)JSON_REALLOC(NULL, NULL, size);
+	if (copy == NULL) {
+		fprintf(stderr, "PANIC: Failed to allocate memory for a number.");
+		exit(-1);
+	}
+	size_t before = (size_t)(dot - str);
+	memcpy(copy, str, before);
+	memcpy(copy + before, point, point_len);
+	memcpy(copy + before + point_len, dot + 1, len - before); // Includes the '\0'
+	double value = strtod(copy, NULL);
+	if (copy != buf) JSON_FREE(NULL, copy);
+	return value;
+}
+
+static uint32_t json__hash(const char* str, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; i++) hash = (hash ^ (uint8_t)str[i]) * 16777619u;
+	return hash;
+}
+
+static uint32_t json__schema_add_node(json_schema_t* schema)
+{
+	if (schema->node_count == schema->node_capacity) {
+		size_t new_capacity = schema->node_capacity == 0 ? 16 : schema->node_capacity * 2;
+		struct json__schema_node* new_nodes = (struct json__schema_node*)JSON_REALLOC(NULL, schema->nodes, new_capacity * sizeof(struct json__schema_node));
+		if (new_nodes == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for json schema.");
+			exit(-1);
+		}
+		schema->nodes = new_nodes;
+		schema->node_capacity = new_capacity;
+	}
+	memset(&schema->nodes[schema->node_count], 0, sizeof(struct json__schema_node));
+	schema->nodes[schema->node_count].first_property = JSON__SCHEMA_NONE;
+	return (uint32_t)schema->node_count++;
+}
+
+// Find a property of a node by name or add it, the node of a new property accepts anything.
+static uint32_t json__schema_property(json_schema_t* schema, uint32_t node, const char* name, size_t len)
+{
+	uint32_t hash = json__hash(name, len);
+	uint32_t last = JSON__SCHEMA_NONE;
+	for (uint32_t index = schema->nodes[node].first_property; index != JSON__SCHEMA_NONE; index = schema->properties[index].next) {
+		const struct json__schema_property* property = &schema->properties[index];
+		if (property->hash == hash && property->name_length == len && memcmp(schema->names + property->name, name, len) == 0) return index;
+		last = index;
+	}
+
+	if (schema->property_count == schema->property_capacity) {
+		size_t new_capacity = schema->property_capacity == 0 ? 16 : schema->property_capacity * 2;
+		struct json__schema_property* new_properties = (struct json__schema_property*)JSON_REALLOC(NULL, schema->properties, new_capacity * sizeof(struct json__schema_property));
+		if (new_properties == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for json schema.");
+			exit(-1);
+		}
+		schema->properties = new_properties;
+		schema->property_capacity = new_capacity;
+	}
+	if (schema->names_size + len > schema->names_capacity) {
+		size_t new_capacity = schema->names_capacity == 0 ? 256 : schema->names_capacity * 2;
+		while (schema->names_size + len > new_capacity) new_capacity *= 2;
+		char* new_names = (char*)JSON_REALLOC(NULL, schema->names, new_capacity);
+		if (new_names == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for json schema.");
+			exit(-1);
+		}
+		schema->names = new_names;
+		schema->names_capacity = new_capacity;
+	}
+
+	struct json__schema_property* property = &schema->properties[schema->property_count];
+	property->name = (uint32_t)schema->names_size;
+	property->name_length = (uint32_t)len;
+	property->hash = hash;
+	property->node = 0;
+	property->next = JSON__SCHEMA_NONE;
+	property->required_bit = 0;
+	memcpy(schema->names + schema->names_size, name, len);
+	schema->names_size += len;
+	if (last == JSON__SCHEMA_NONE) schema->nodes[node].first_property = (uint32_t)schema->property_count;
+	else schema->properties[last].next = (uint32_t)schema->property_count;
+	return (uint32_t)schema->property_count++;
+}
+
+static int json__skip_value(json_t* json, json_token_t tok)
+{
+	int depth = 0;
+	for (;;) {
+		if (tok == JSON_START_OBJECT || tok == JSON_START_ARRAY) depth++;
+		else if (tok == JSON_END_OBJECT || tok == JSON_END_ARRAY) depth--;
+		else if (tok == JSON_ERROR || tok == JSON_WOULD_BLOCK || tok == JSON_END_DOCUMENT) return 0;
+		if (depth == 0) return 1;
+		tok = json_next_token(json);
+	}
+}
+
+static uint32_t json__schema_type(const char* name)
+{
+	if (strcmp(name, "object") == 0) return JSON__TYPE_OBJECT;
+	if (strcmp(name, "array") == 0) return JSON__TYPE_ARRAY;
+	if (strcmp(name, "string") == 0) return JSON__TYPE_STRING;
+	if (strcmp(name, "integer") == 0) return JSON__TYPE_INTEGER;
+	if (strcmp(name, "number") == 0) return JSON__TYPE_NUMBER | JSON__TYPE_INTEGER;
+	if (strcmp(name, "boolean") == 0) return JSON__TYPE_BOOLEAN;
+	if (strcmp(name, "null") == 0) return JSON__TYPE_NULL;
+	return 0;
+}
+
+static const char* const json__schema_keywords[] = {
+	"type", "properties", "required", "additionalProperties", "items", "minimum", "maximum", "exclusiveMinimum",
+	"exclusiveMaximum", "minLength", "maxLength", "minItems", "maxItems",
+	"$schema", "$id", "$comment", "title", "description", "default", "examples"
+};
+
+// Compile the schema that starts with tok, returns the node or JSON__SCHEMA_NONE if it is invalid.
+static uint32_t json__schema_compile(json_schema_t* schema, json_t* json, json_token_t tok)
+{
+	if (tok == JSON_BOOLEAN && strcmp(json_get_value(json), "true") == 0) return 0;
+	if (tok != JSON_START_OBJECT) return JSON__SCHEMA_NONE;
+
+	uint32_t node = json__schema_add_node(schema);
+	while ((tok = json_next_token(json)) == JSON_NAME) {
+		size_t keyword = 0;
+		const char* name = json_get_name(json);
+		while (keyword < sizeof(json__schema_keywords) / sizeof(json__schema_keywords[0]) && strcmp(name, json__schema_keywords[keyword]) != 0) keyword++;
+
+		tok = json_next_token(json);
+		int number = tok == JSON_INT64 || tok == JSON_UINT64 || tok == JSON_DOUBLE;
+		double value = number ? json__parse_double(json_get_value(json)) : 0.0;
+		uint64_t count = tok == JSON_UINT64 ? (uint64_t)value : 0;
+		uint32_t flag = 0;
+		switch (keyword) {
+		case 0: // type
+			if (tok == JSON_STRING) {
+				uint32_t type = json__schema_type(json_get_value(json));
+				if (type == 0) return JSON__SCHEMA_NONE;
+				schema->nodes[node].types |= type;
+				break;
+			}
+			if (tok != JSON_START_ARRAY) return JSON__SCHEMA_NONE;
+			while ((tok = json_next_token(json)) == JSON_STRING) {
+				uint32_t type = json__schema_type(json_get_value(json));
+				if (type == 0) return JSON__SCHEMA_NONE;
+				schema->nodes[node].types |= type;
+			}
+			if (tok != JSON_END_ARRAY) return JSON__SCHEMA_NONE;
+			break;
+		case 1: // properties
+			if (tok != JSON_START_OBJECT) return JSON__SCHEMA_NONE;
+			while ((tok = json_next_token(json)) == JSON_NAME) {
+				uint32_t property = json__schema_property(schema, node, json_get_name(json), json_get_length(json));
+				uint32_t child = json__schema_compile(schema, json, json_next_token(json));
+				if (child == JSON__SCHEMA_NONE) return JSON__SCHEMA_NONE;
+				schema->properties[property].node = child;
+			}
+			if (tok != JSON_END_OBJECT) return JSON__SCHEMA_NONE;
+			break;
+		case 2: // required
+			if (tok != JSON_START_ARRAY) return JSON__SCHEMA_NONE;
+			while ((tok = json_next_token(json)) == JSON_STRING) {
+				uint32_t property = json__schema_property(schema, node, json_get_value(json), json_get_length(json));
+				if (schema->properties[property].required_bit != 0) continue;
+				if (schema->nodes[node].required_mask == UINT64_MAX) return JSON__SCHEMA_NONE;
+				schema->properties[property].required_bit = schema->nodes[node].required_mask + 1;
+				schema->nodes[node].required_mask = schema->nodes[node].required_mask * 2 + 1;
+			}
+			if (tok != JSON_END_ARRAY) return JSON__SCHEMA_NONE;
+			break;
+		case 3: // additionalProperties
+			if (tok != JSON_BOOLEAN) return JSON__SCHEMA_NONE;
+			if (strcmp(json_get_value(json), "false") == 0) schema->nodes[node].flags |= JSON__SCHEMA_CLOSED;
+			break;
+		case 4: { // items
+			uint32_t child = json__schema_compile(schema, json, tok);
+			if (child == JSON__SCHEMA_NONE) return JSON__SCHEMA_NONE;
+			schema->nodes[node].items = child;
+			break;
+		}
+		case 5: case 6: case 7: case 8: // minimum, maximum, exclusiveMinimum, exclusiveMaximum
+			if (!number) return JSON__SCHEMA_NONE;
+			flag = JSON__SCHEMA_MINIMUM << (keyword - 5);
+			if (keyword == 5) schema->nodes[node].minimum = value;
+			else if (keyword == 6) schema->nodes[node].maximum = value;
+			else if (keyword == 7) schema->nodes[node].exclusive_minimum = value;
+			else schema->nodes[node].exclusive_maximum = value;
+			schema->nodes[node].flags |= flag;
+			break;
+		case 9: case 10: case 11: case 12: // minLength, maxLength, minItems, maxItems
+			if (tok != JSON_UINT64 && !(tok == JSON_INT64 && value == 0.0)) return JSON__SCHEMA_NONE;
+			flag = JSON__SCHEMA_MIN_LENGTH << (keyword - 9);
+			if (keyword == 9) schema->nodes[node].min_length = count;
+			else if (keyword == 10) schema->nodes[node].max_length = count;
+			else if (keyword == 11) schema->nodes[node].min_items = count;
+			else schema->nodes[node].max_items = count;
+			schema->nodes[node].flags |= flag;
+			break;
+		default:
+			if (keyword == sizeof(json__schema_keywords) / sizeof(json__schema_keywords[0]) || !json__skip_value(json, tok)) return JSON__SCHEMA_NONE;
+			break;
+		}
+	}
+	return tok == JSON_END_OBJECT ? node : JSON__SCHEMA_NONE;
+}
+
+json_schema_t* json_schema_compile(json_t* json)
+{
+	json_schema_t* schema = (json_schema_t*)JSON_REALLOC(NULL, NULL, sizeof(json_schema_t));
+	if (schema == NULL) {
+		fprintf(stderr, "PANIC: Failed to allocate memory for json schema.");
+		exit(-1);
+	}
+	memset(schema, 0, sizeof(json_schema_t));
+	json__schema_add_node(schema);
+
+	if (json__schema_compile(schema, json, json_next_token(json)) != 1 || json_next_token(json) != JSON_END_DOCUMENT) {
+		json_schema_free(schema);
+		return NULL;
+	}
+	return schema;
+}
+
+void json_schema_free(json_schema_t* schema)
+{
+	if (schema == NULL) return;
+	JSON_FREE(NULL, schema->nodes);
+	JSON_FREE(NULL, schema->properties);
+	JSON_FREE(NULL, schema->names);
+	JSON_FREE(NULL, schema);
+}
+
+void json_set_schema(json_t* json, const json_schema_t* schema)
+{
+	json->schema = schema;
+}
+
+void json_set_stream(json_t* json, int stream)
+{
+	json->stream = stream;
+}
+
+static int json__violation(json_t* json, enum json__schema_violation violation, int depth, uint32_t arg)
+{
+	json->violation = violation;
+	json->violation_depth = depth;
+	json->violation_arg = arg;
+	return 0;
+}
+
+// Check a token against the schema, called by json_next_token() before a token is returned.
+static int json__validate(json_t* json, json_token_t tok)
+{
+	const json_schema_t* schema = json->schema;
+	struct json__schema_frame* frame = &json->schema_stack[json->level];
+	const struct json__schema_node* node;
+	uint32_t index, type;
+	int parent = json->level;
+
+	switch (tok) {
+	case JSON_NAME:
+		frame->key = JSON__SCHEMA_NONE;
+		if (frame->node == 0) return 1;
+		{
+			const char* name = json_get_name(json);
+			size_t len = json_get_length(json);
+			uint32_t hash = json__hash(name, len);
+			for (index = schema->nodes[frame->node].first_property; index != JSON__SCHEMA_NONE; index = schema->properties[index].next) {
+				const struct json__schema_property* property = &schema->properties[index];
+				if (property->hash == hash && property->name_length == len && memcmp(schema->names + property->name, name, len) == 0) {
+					frame->key = index;
+					frame->seen |= property->required_bit;
+					return 1;
+				}
+			}
+		}
+		if (schema->nodes[frame->node].flags & JSON__SCHEMA_CLOSED) return json__violation(json, JSON__VIOLATION_UNKNOWN_KEY, json->level, 0);
+		return 1;
+	case JSON_END_OBJECT:
+		node = &schema->nodes[frame->node];
+		if ((frame->seen & node->required_mask) != node->required_mask) {
+			for (index = node->first_property; index != JSON__SCHEMA_NONE; index = schema->properties[index].next) {
+				if (schema->properties[index].required_bit & ~frame->seen) break;
+			}
+			return json__violation(json, JSON__VIOLATION_REQUIRED, json->level - 1, index);
+		}
+		return 1;
+	case JSON_END_ARRAY:
+		node = &schema->nodes[frame->node];
+		if ((node->flags & JSON__SCHEMA_MIN_ITEMS) && frame->count < node->min_items) return json__violation(json, JSON__VIOLATION_MIN_ITEMS, json->level - 1, 0);
+		if ((node->flags & JSON__SCHEMA_MAX_ITEMS) && frame->count > node->max_items) return json__violation(json, JSON__VIOLATION_MAX_ITEMS, json->level - 1, 0);
+		return 1;
+	case JSON_START_OBJECT: type = JSON__TYPE_OBJECT; parent--; break;
+	case JSON_START_ARRAY: type = JSON__TYPE_ARRAY; parent--; break;
+	case JSON_STRING: type = JSON__TYPE_STRING; break;
+	case JSON_INT64: case JSON_UINT64: type = JSON__TYPE_INTEGER; break;
+	case JSON_DOUBLE: type = JSON__TYPE_NUMBER; break;
+	case JSON_BOOLEAN: type = JSON__TYPE_BOOLEAN; break;
+	case JSON_NULL: type = JSON__TYPE_NULL; break;
+	default: return 1;
+	}
+
+	// The schema of a value is the root, the items of the array or the property of the object it is in.
+	frame = &json->schema_stack[parent];
+	if (parent == 0) index = 1;
+	else if (frame->array) {
+		frame->count++;
+		index = schema->nodes[frame->node].items;
+	}
+	else index = frame->key == JSON__SCHEMA_NONE ? 0 : schema->properties[frame->key].node;
+	node = &schema->nodes[index];
+
+	if (node->types != 0 && (node->types & type) == 0) return json__violation(json, JSON__VIOLATION_TYPE, parent, index);
+	if ((type == JSON__TYPE_INTEGER || type == JSON__TYPE_NUMBER) && (node->flags & (JSON__SCHEMA_MINIMUM | JSON__SCHEMA_MAXIMUM | JSON__SCHEMA_EXCLUSIVE_MINIMUM | JSON__SCHEMA_EXCLUSIVE_MAXIMUM))) {
+		double value = json__parse_double(json_get_value(json));
+		if ((node->flags & JSON__SCHEMA_MINIMUM) && value < node->minimum) return json__violation(json, JSON__VIOLATION_MINIMUM, parent, 0);
+		if ((node->flags & JSON__SCHEMA_EXCLUSIVE_MINIMUM) && value <= node->exclusive_minimum) return json__violation(json, JSON__VIOLATION_MINIMUM, parent, 0);
+		if ((node->flags & JSON__SCHEMA_MAXIMUM) && value > node->maximum) return json__violation(json, JSON__VIOLATION_MAXIMUM, parent, 0);
+		if ((node->flags & JSON__SCHEMA_EXCLUSIVE_MAXIMUM) && value >= node->exclusive_maximum) return json__violation(json, JSON__VIOLATION_MAXIMUM, parent, 0);
+	}
+	if (type == JSON__TYPE_STRING && (node->flags & (JSON__SCHEMA_MIN_LENGTH | JSON__SCHEMA_MAX_LENGTH)) && !json->raw) {
+		// The length is in code points, count the bytes that do not continue a UTF-8 sequence.
+		const char* str = json_get_value(json);
+		size_t len = json_get_length(json);
+		uint64_t chars = 0;
+		for (size_t i = 0; i < len; i++) chars += ((uint8_t)str[i] & 0xC0) != 0x80;
+		if ((node->flags & JSON__SCHEMA_MIN_LENGTH) && chars < node->min_length) return json__violation(json, JSON__VIOLATION_MIN_LENGTH, parent, 0);
+		if ((node->flags & JSON__SCHEMA_MAX_LENGTH) && chars > node->max_length) return json__violation(json, JSON__VIOLATION_MAX_LENGTH, parent, 0);
+	}
+	if (type == JSON__TYPE_OBJECT || type == JSON__TYPE_ARRAY) {
+		frame = &json->schema_stack[json->level];
+		frame->node = index;
+		frame->key = JSON__SCHEMA_NONE;
+		frame->array = type == JSON__TYPE_ARRAY;
+		frame->seen = 0;
+		frame->count = 0;
+	}
+	return 1;
+}
+
+static const char* const json__type_names[] = { "object", "array", "string", "integer", "number", "boolean", "null" };
+
+static void json__push_cstr(json_t* json, const char* str)
+{
+	json__push(json, str, json__strlen(str));
+}
+
+// Push the error message of a schema violation, e.g. "Error(3,12): $.persons[2].age: Value is greater than the maximum.".
+static void json__push_schema_error(json_t* json)
+{
+	const json_schema_t* schema = json->schema;
+	size_t sc = json->sc, name = 0, name_length = 0;
+	uint8_t postfix = 'e', zero = '\0';
+	char buf[32];
+
+	if (json->violation == JSON__VIOLATION_UNKNOWN_KEY) { // The key is in the name frame on top of the stack
+		name_length = json_get_length(json);
+		name = (size_t)(json_get_name(json) - (const char*)json->stack);
+	}
+	json__push_cstr(json, json__error_prefix);
+	json__push_cstr(json, json__itoa(buf, sizeof(buf), json->row, 10));
+	json__push_cstr(json, ",");
+	json__push_cstr(json, json__itoa(buf, sizeof(buf), json->col, 10));
+	json__push_cstr(json, "): $");
+	for (int i = 1; i <= json->violation_depth; i++) {
+		const struct json__schema_frame* frame = &json->schema_stack[i];
+		if (frame->array) {
+			json__push_cstr(json, "[");
+			json__push_cstr(json, json__itoa(buf, sizeof(buf), (int64_t)frame->count - 1, 10));
+			json__push_cstr(json, "]");
+		}
+		else if (frame->key != JSON__SCHEMA_NONE) {
+			json__push_cstr(json, ".");
+			json__push(json, schema->names + schema->properties[frame->key].name, schema->properties[frame->key].name_length);
+		}
+	}
+	if (json->violation == JSON__VIOLATION_UNKNOWN_KEY) {
+		json__push_cstr(json, ".");
+		for (size_t i = 0; i < name_length; i++) json__push(json, &json->stack[name + i], sizeof(uint8_t));
+	}
+	json__push_cstr(json, ": ");
+
+	switch (json->violation) {
+	case JSON__VIOLATION_TYPE: {
+		uint32_t types = schema->nodes[json->violation_arg].types;
+		if (types & JSON__TYPE_NUMBER) types &= ~JSON__TYPE_INTEGER;
+		json__push_cstr(json, "Expected type ");
+		for (int i = 0, first = 1; i < 7; i++) {
+			if ((types & (1u << i)) == 0) continue;
+			if (!first) json__push_cstr(json, " or ");
+			json__push_cstr(json, json__type_names[i]);
+			first = 0;
+		}
+		json__push_cstr(json, ".");
+		break;
+	}
+	case JSON__VIOLATION_MINIMUM: json__push_cstr(json, "Value is less than the minimum."); break;
+	case JSON__VIOLATION_MAXIMUM: json__push_cstr(json, "Value is greater than the maximum."); break;
+	case JSON__VIOLATION_MIN_LENGTH: json__push_cstr(json, "String is shorter than minLength."); break;
+	case JSON__VIOLATION_MAX_LENGTH: json__push_cstr(json, "String is longer than maxLength."); break;
+	case JSON__VIOLATION_MIN_ITEMS: json__push_cstr(json, "Array has fewer items than minItems."); break;
+	case JSON__VIOLATION_MAX_ITEMS: json__push_cstr(json, "Array has more items than maxItems."); break;
+	case JSON__VIOLATION_UNKNOWN_KEY: json__push_cstr(json, "Key is not allowed."); break;
+	case JSON__VIOLATION_REQUIRED:
+		json__push_cstr(json, "Missing required key '");
+		json__push(json, schema->names + schema->properties[json->violation_arg].name, schema->properties[json->violation_arg].name_length);
+		json__push_cstr(json, "'.");
+		break;
+	}
+	json__push(json, &zero, sizeof(uint8_t));
+	int len = (int)(json->sc - sc);
+	json__push(json, &len, sizeof(int));
+	json__push(json, &postfix, sizeof(uint8_t));
+}
+
+json_token_t json_next_token(json_t* json)
+{
+	size_t sc;
+	int len;
+	uint8_t ch, n, postfix, comma;
+	char buf[32];
+#ifdef JSON__THREADED
+	static void* const json__dispatch[] = { JSON__LABELS(JSON__LABEL_ADDRESS) };
+	goto *json__dispatch[json->lc];
+	{
+#else
+jp: switch (json->lc) {
+#endif
+	LABEL(json__start);
+	GETC(json__g1);
+	if (json->ch == EOF && !json->stream) JMP(json__error);
+	if (json->ch == 0xEF) for (json->rd = 0; json->rd < 3; json->rd++) { // Ignore BOM
+		GETC(json__g2);
+		if (json->ch == EOF) JMP(json__error);
+	}
+	json->col = 1;
+	CALL(json__c1, json__padding);
+	LABEL(json__document);
+	if (json->ch == EOF && json->stream && json->input != JSON__INPUT_ERROR) JMP(json__end_document);
+	json->level = 1;
+	json__mark_token(json);
+	if (json->ch == '{') CALL(json__c2, json__object);
+	else if (json->ch == '[') CALL(json__c3, json__array);
+	else JMP(json__error);
+	GETC(json__g3);
+	CALL(json__c18, json__padding);
+	if (json->stream && json->ch != EOF && json->input != JSON__INPUT_ERROR) JMP(json__document);
+	if (json->ch != EOF || json->input == JSON__INPUT_ERROR) JMP(json__error);
+	LABEL(json__end_document);
+	json__mark_token(json);
+	for (;;) TOK(json__t1, JSON_END_DOCUMENT);
+
+	// json_seek_element() starts here, inside the top-level array at the first byte of an element.
+	LABEL(json__resume);
+	GETC(json__g28);
+	JMP(json__array_l1);
+
+	LABEL(json__padding);
+	while (json->ch == ' ' || json->ch == '\r' || json->ch == '\n' || json->ch == '\t' || json->ch == '\f') {
+		GETC(json__g4);
+	}
+	RET();
+
+	LABEL(json__element);
+	json__mark_token(json);
+	if (json->ch == '\"') {
+		json->rb = json->sc;
+		CALL(json__c12, json__string);
+		n = '\0';
+		postfix = 's';
 		json__push(json, &n, sizeof(uint8_t));
-		len = json->sc - sc;
+		len = (int)(json->sc - json->rb);
 		json__push(json, &len, sizeof(int));
 		json__push(json, &postfix, sizeof(uint8_t));
 		TOK(json__t5, JSON_STRING);
 		json__pop_str(json);
+		json->mark = NULL;
 		RET();
 	}
 	else if (json->ch == '-') {
 		json->number_type = JSON__NUMBER_INT64;
 		json->ra = json->sc;
-		uint8_t ch = '-'; json__push(json, &ch, sizeof(uint8_t));
-		json__getc(json);
+		ch = '-'; json__push(json, &ch, sizeof(uint8_t));
+		GETC(json__g5);
 		if (json->ch >= '0' && json->ch <= '9') JMP(json__number);
 		JMP(json__error);
 	}
@@ -391,8 +1868,8 @@ jp: switch (json->lc) {
 	else if (json->ch == '0') {
 		json->number_type = JSON__NUMBER_INT64;
 		json->ra = json->sc;
-		uint8_t ch = '0'; json__push(json, &ch, sizeof(uint8_t));
-		json__getc(json);
+		ch = '0'; json__push(json, &ch, sizeof(uint8_t));
+		GETC(json__g6);
 		if (json->ch == '.') JMP(json__number_l1);
 		JMP(json__number_l2);
 	}
@@ -409,49 +1886,52 @@ jp: switch (json->lc) {
 	LABEL(json__object);
 	if (json->level > MAX_NESTING_LEVEL) JMP(json__error);
 	TOK(json__t2, JSON_START_OBJECT);
-	json__getc(json);
+	GETC(json__g7);
 	CALL(json__c5, json__padding);
 	LABEL(json__object_l1);
+	json__mark_token(json);
 	switch (json->ch) {
 	case '\"': break;
 	case '}': JMP(json__object_l2);
 	default: JMP(json__error);
 	}
 	{
-		sc = json->sc;
+		json->rb = json->sc;
+		CALL(json__c6, json__string);
 		n = '\0';
 		postfix = 'n';
-		CALL(json__c6, json__string);
 		json__push(json, &n, sizeof(uint8_t));
-		len = json->sc - sc;
+		len = (int)(json->sc - json->rb);
 		json__push(json, &len, sizeof(int));
 		json__push(json, &postfix, sizeof(uint8_t));
 		TOK(json__t3, JSON_NAME);
 		json__pop_str(json);
+		json->mark = NULL;
 	}
 	CALL(json__c7, json__padding);
 	if (json->ch != ':') JMP(json__error);
-	json__getc(json);
+	GETC(json__g8);
 	CALL(json__c8, json__padding);
 	CALL(json__c9, json__element);
 	CALL(json__c10, json__padding);
 	if (json->ch == ',') {
-		json__getc(json);
+		GETC(json__g9);
 		CALL(json__c11, json__padding);
 		if (json->ch == '}') JMP(json__error);
 		JMP(json__object_l1);
 	}
 	else if (json->ch != '}') JMP(json__error);
+	json__mark_token(json);
 	LABEL(json__object_l2);
 	TOK(json__t4, JSON_END_OBJECT);
 	json->level--;
-	if (json->level > 0) json__getc(json);
+	if (json->level > 0) GETC(json__g10);
 	RET();
 
 	LABEL(json__number); {
 		ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
 		for (;;) {
-			json__getc(json);
+			GETC(json__g11);
 			if (json->ch >= '0' && json->ch <= '9') {
 				ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
 			}
@@ -462,7 +1942,7 @@ jp: switch (json->lc) {
 			json->number_type = JSON__NUMBER_DOUBLE;
 			ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
 			for (;;) {
-				json__getc(json);
+				GETC(json__g12);
 				if (json->ch >= '0' && json->ch <= '9') {
 					ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
 				}
@@ -472,13 +1952,13 @@ jp: switch (json->lc) {
 		if (json->ch == 'e' || json->ch == 'E') {
 			json->number_type = JSON__NUMBER_DOUBLE;
 			ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
-			json__getc(json);
+			GETC(json__g13);
 			if (json->ch == '+' || json->ch == '-' || (json->ch >= '0' && json->ch <= '9')) {
 				ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
 			}
 			else JMP(json__error);
 			for (;;) {
-				json__getc(json);
+				GETC(json__g14);
 				if (json->ch >= '0' && json->ch <= '9') {
 					ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
 				}
@@ -489,7 +1969,7 @@ jp: switch (json->lc) {
 		{
 			n = '\0';
 			json__push(json, &n, sizeof(uint8_t));
-			len = json->sc - json->ra;
+			len = (int)(json->sc - json->ra);
 			json__push(json, &len, sizeof(int));
 			if (json->number_type == JSON__NUMBER_UINT64) {
 				postfix = 'u';
@@ -508,151 +1988,139 @@ jp: switch (json->lc) {
 			}
 			json__pop_str(json);
 		}
-		json->col--;
 	} RET();
 
 	LABEL(json__array);
-	if (!json__getc(json)) JMP(json__error);
+	GETC(json__g15);
+	if (json->ch == EOF) JMP(json__error);
 	if (json->level > MAX_NESTING_LEVEL) JMP(json__error);
 	TOK(json__t9, JSON_START_ARRAY);
 	CALL(json__c13, json__padding);
-	if (json->ch == ']') JMP(json__array_l2);
+	if (json->ch == ']') {
+		json__mark_token(json);
+		JMP(json__array_l2);
+	}
 	LABEL(json__array_l1);
 	CALL(json__c14, json__element);
 	CALL(json__c15, json__padding);
 	if (json->ch == ',') {
-		json__getc(json);
+		GETC(json__g16);
 		CALL(json__c17, json__padding);
 		if (json->ch == ']') JMP(json__error);
 		JMP(json__array_l1);
 	}
 	else if (json->ch == ']') {
+		json__mark_token(json);
 		LABEL(json__array_l2);
 		TOK(json__t11, JSON_END_ARRAY);
 		json->level--;
-		if (json->level > 0) json__getc(json);
+		if (json->level > 0) GETC(json__g17);
 	}
 	else JMP(json__error);
 	RET();
 
+	// In raw mode the string is validated but not decoded, json->mark and json->span_len is the source text.
 	LABEL(json__string); {
-		enum json__label lc = (*(enum json__label*)json__pop(json, sizeof(enum json__label)));
+		if (json->raw) json->mark = json->buf_pos - 1;
 		for (;;) {
-			json__getc(json);
+			{
+				// Take the plain characters that are already in the buffer in one go.
+				const uint8_t* p = json->buf_pos;
+				while (p < json->buf_end && *p >= 0x20 && *p != '\"' && *p != '\\') p++;
+				if (!json->raw) json__push(json, json->buf_pos, (size_t)(p - json->buf_pos));
+				json->col += (int64_t)(p - json->buf_pos);
+				json->buf_pos = p;
+			}
+			GETC(json__g18);
 			if (json->ch == '\"') break;
-			else if (json->ch < 0x20 || json->ch > 0x10FFFF) JMP(json__error);
+			else if (json->ch < 0x20) JMP(json__error);
 			else if (json->ch == '\\') {
-				json__getc(json);
-				uint8_t ch;
-				switch (json->ch) {
-				case '"': ch = '\"';  json__push(json, &ch, sizeof(uint8_t)); break;
-				case '/': ch = '/';  json__push(json, &ch, sizeof(uint8_t)); break;
-				case '\\': ch = '\\'; json__push(json, &ch, sizeof(uint8_t)); break;
-				case 'b': ch = '\b'; json__push(json, &ch, sizeof(uint8_t)); break;
-				case 'f': ch = '\f'; json__push(json, &ch, sizeof(uint8_t)); break;
-				case 'n': ch = '\n'; json__push(json, &ch, sizeof(uint8_t)); break;
-				case 'r': ch = '\r'; json__push(json, &ch, sizeof(uint8_t)); break;
-				case 't': ch = '\t'; json__push(json, &ch, sizeof(uint8_t)); break;
-				case 'u': {
-					int hex[4];
-					for (int i = 0; i < 4; i++) {
-						json__getc(json);
+				GETC(json__g19);
+				if (json->ch == 'u') {
+					json->re = 0;
+					for (json->rd = 0; json->rd < 4; json->rd++) {
+						GETC(json__g20);
 						if (!((json->ch >= '0' && json->ch <= '9') || (json->ch >= 'a' && json->ch <= 'f') || (json->ch >= 'A' && json->ch <= 'F'))) {
 							JMP(json__error);
 						}
-						hex[i] = json->ch;
+						json->re = (json->re << 4) + json__hex_to_int(json->ch);
+					}
+					if (!json->raw) json__push_utf8(json, json->re);
+				}
+				else {
+					switch (json->ch) {
+					case '"': ch = '\"'; break;
+					case '/': ch = '/'; break;
+					case '\\': ch = '\\'; break;
+					case 'b': ch = '\b'; break;
+					case 'f': ch = '\f'; break;
+					case 'n': ch = '\n'; break;
+					case 'r': ch = '\r'; break;
+					case 't': ch = '\t'; break;
+					default: JMP(json__error);
 					}
-					json__push_hex(json, hex);
-				} break;
-				default: JMP(json__error);
+					if (!json->raw) json__push(json, &ch, sizeof(uint8_t));
 				}
 			}
-			else {
-				uint8_t ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
+			else if (!json->raw) {
+				ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
 			}
 		}
-		json__push(json, &lc, sizeof(enum json__label));
-		json__getc(json);
+		if (json->raw) json->span_len = (size_t)(json->buf_pos - json->mark);
+		GETC(json__g21);
 	}
 	RET();
 
-	LABEL(json__true); {
-		len = 5;
-		ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
-		n = '\0';
-		pf = 'b';
-		for (int i = 0; i < 3; i++) {
-			if (!json__getc(json)) JMP(json__error);
-			ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
-		}
-		json__push(json, &n, sizeof(uint8_t));
-		json__push(json, &len, sizeof(int));
-		json__push(json, &pf, sizeof(uint8_t));
-		if (json__strncmp("true", json__peek_str(json), 4) == 0) {
-			TOK(json__t12, JSON_BOOLEAN);
-			json__pop_str(json);
-			json__getc(json);
-		}
-		else JMP(json__error);
-	} RET();
+	LABEL(json__true);
+	for (json->rd = 1; json->rd < 4; json->rd++) {
+		GETC(json__g22);
+		if (json->ch != "true"[json->rd]) JMP(json__error);
+	}
+	json__push_str(json, "true", 'b');
+	TOK(json__t12, JSON_BOOLEAN);
+	json__pop_str(json);
+	GETC(json__g23);
+	RET();
 
-	LABEL(json__false); {
-		len = 6;
-		n = '\0';
-		pf = 'b';
-		ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
-		for (int i = 0; i < 4; i++) {
-			if (!json__getc(json)) JMP(json__error);
-			ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
-		}
-		json__push(json, &n, sizeof(uint8_t));
-		json__push(json, &len, sizeof(int));
-		json__push(json, &pf, sizeof(uint8_t));
-		if (json__strncmp("false", json__peek_str(json), 5) == 0) {
-			TOK(json__t13, JSON_BOOLEAN);
-			json__pop_str(json);
-			json__getc(json);
-		}
-		else JMP(json__error);
-	} RET();
+	LABEL(json__false);
+	for (json->rd = 1; json->rd < 5; json->rd++) {
+		GETC(json__g24);
+		if (json->ch != "false"[json->rd]) JMP(json__error);
+	}
+	json__push_str(json, "false", 'b');
+	TOK(json__t13, JSON_BOOLEAN);
+	json__pop_str(json);
+	GETC(json__g25);
+	RET();
 
 	LABEL(json__null);
-	len = 5;
-	n = '\0';
-	pf = 'z';
-	ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
-	for (int i = 0; i < 3; i++) {
-		if (!json__getc(json)) JMP(json__error);
-		ch = json->ch; json__push(json, &ch, sizeof(uint8_t));
-	}
-	json__push(json, &n, sizeof(uint8_t));
-	json__push(json, &len, sizeof(int));
-	json__push(json, &pf, sizeof(uint8_t));
-	if (json__strncmp("null", json__peek_str(json), 4) == 0) {
-		TOK(json__t14, JSON_NULL);
-		json__pop_str(json);
-		json__getc(json);
+	for (json->rd = 1; json->rd < 4; json->rd++) {
+		GETC(json__g26);
+		if (json->ch != "null"[json->rd]) JMP(json__error);
 	}
-	else JMP(json__error);
+	json__push_str(json, "null", 'z');
+	TOK(json__t14, JSON_NULL);
+	json__pop_str(json);
+	GETC(json__g27);
 	RET();
 
 	LABEL(json__error);
 	{
+		json__mark_token(json);
 		sc = json->sc;
 		comma = ',';
-		pf = 'e';
-		if (feof(json->fp)) {
-			json__push(json, json__error_unexpected_end_of_file, sizeof(json__error_unexpected_end_of_file));
-			int len = (int)sizeof(json__error_unexpected_end_of_file);
-			json__push(json, &len, sizeof(int));
-			json__push(json, &pf, sizeof(uint8_t));
-		}
-		else if (ferror(json->fp)) {
-			size_t sc = json->sc;
+		postfix = 'e';
+		if (json->ch == EOF && json->input == JSON__INPUT_ERROR) {
 			json__push(json, json__error_while_reading_file, sizeof(json__error_while_reading_file));
 			int len = (int)sizeof(json__error_while_reading_file);
 			json__push(json, &len, sizeof(int));
-			json__push(json, &pf, sizeof(uint8_t));
+			json__push(json, &postfix, sizeof(uint8_t));
+		}
+		else if (json->ch == EOF) {
+			json__push(json, json__error_unexpected_end_of_file, sizeof(json__error_unexpected_end_of_file));
+			int len = (int)sizeof(json__error_unexpected_end_of_file);
+			json__push(json, &len, sizeof(int));
+			json__push(json, &postfix, sizeof(uint8_t));
 		}
 		else {
 			json__push(json, json__error_prefix, sizeof(json__error_prefix) - 1);
@@ -664,17 +2132,39 @@ jp: switch (json->lc) {
 			json__push(json, json__unexpected_sign, sizeof(json__unexpected_sign));
 			int len = (int)(json->sc - sc);
 			json__push(json, &len, sizeof(int));
-			json__push(json, &pf, sizeof(uint8_t));
+			json__push(json, &postfix, sizeof(uint8_t));
 		}
 		for (;;) TOK(json__error_loop, JSON_ERROR);
 	}
+
+	LABEL(json__schema_error);
+	json__push_schema_error(json);
+	JMP(json__error_loop);
+#ifndef JSON__THREADED
 	default: break;
+#endif
 	}
 	return JSON_ERROR;
 }
 
+json_token_t json_pump(json_t* json, int (*callback)(void* user, json_t* json, json_token_t tok), void* user)
+{
+	json_token_t tok;
+	do {
+		tok = json_next_token(json);
+		if (tok == JSON_WOULD_BLOCK || !callback(user, json, tok)) break;
+	} while (tok != JSON_END_DOCUMENT && tok != JSON_ERROR);
+	return tok;
+}
+
+// The postfix of the value on top of the stack, 0 if the stack is empty.
+static uint8_t json__postfix(json_t* json)
+{
+	return json->sc > 0 ? json->stack[json->sc - sizeof(uint8_t)] : 0;
+}
+
 const char* json_get_error(json_t* json) {
-	if (json->stack[json->sc - sizeof(uint8_t)] == 'e') {
+	if (json__postfix(json) == 'e') {
 		int cnt = *(int*)json__peek(json, sizeof(int), sizeof(uint8_t));
 		return (const char*)&json->stack[(size_t)json->sc - cnt - sizeof(int) - sizeof(uint8_t)];
 	}
@@ -682,7 +2172,7 @@ const char* json_get_error(json_t* json) {
 }
 
 const char* json_get_name(json_t* json) {
-	if (json->stack[json->sc - sizeof(uint8_t)] == 'n') {
+	if (json__postfix(json) == 'n') {
 		int cnt = *(int*)json__peek(json, sizeof(int), sizeof(uint8_t));
 		return (const char*)&json->stack[(size_t)json->sc - cnt - sizeof(int) - sizeof(uint8_t)];
 	}
@@ -690,7 +2180,7 @@ const char* json_get_name(json_t* json) {
 }
 
 const char* json_get_value(json_t* json) {
-	uint8_t t = json->stack[json->sc - sizeof(uint8_t)];
+	uint8_t t = json__postfix(json);
 	if (t == 's' || t == 'u' || t == 'i' || t == 'd' || t == 'b' || t == 'z') {
 		int cnt = *(int*)json__peek(json, sizeof(int), sizeof(uint8_t));
 		return (const char*)&json->stack[(size_t)json->sc - cnt - sizeof(int) - sizeof(uint8_t)];
@@ -698,14 +2188,1142 @@ const char* json_get_value(json_t* json) {
 	return NULL;
 }
 
+size_t json_get_length(json_t* json) {
+	uint8_t t = json__postfix(json);
+	if (t == 's' || t == 'u' || t == 'i' || t == 'd' || t == 'b' || t == 'z' || t == 'n' || t == 'e') {
+		int cnt = *(int*)json__peek(json, sizeof(int), sizeof(uint8_t));
+		return (size_t)cnt - 1;
+	}
+	return 0;
+}
+
+uint64_t json_get_offset(json_t* json)
+{
+	return json->tok_offset;
+}
+
 void json_close(json_t* json)
 {
-	JSON_FCLOSE(json->fp);
+	if (json->reader.close != NULL) json->reader.close(json->reader.user);
+	JSON_FREE(NULL, json->buf);
 	JSON_FREE(NULL, json->stack);
 	JSON_FREE(NULL, json);
 }
 
 
+struct json__writer {
+	json_sink_t sink;
+	int comma, failed, indent, level, name;
+	size_t pos, capacity;
+	char* buf;
+};
+
+json_writer_t* json_writer_open(const json_sink_t* sink)
+{
+	json_writer_t* writer = (json_writer_t*)JSON_REALLOC(NULL, NULL, sizeof(json_writer_t));
+	if (writer == NULL) return NULL;
+	writer->buf = (char*)JSON_REALLOC(NULL, NULL, JSON_BUFFER_SIZE);
+	if (writer->buf == NULL) {
+		JSON_FREE(NULL, writer);
+		return NULL;
+	}
+	writer->sink = *sink;
+	writer->comma = 0;
+	writer->failed = 0;
+	writer->indent = 0;
+	writer->level = 0;
+	writer->name = 0;
+	writer->pos = 0;
+	writer->capacity = JSON_BUFFER_SIZE;
+	return writer;
+}
+
+static int json__file_write(void* user, const void* data, size_t size)
+{
+	return fwrite(data, 1, size, (FILE*)user) == size ? 0 : -1;
+}
+
+json_writer_t* json_writer_fopen(const char* filename)
+{
+	FILE* fp = NULL;
+
+	if (JSON_FOPEN(fp, filename, "wb") != 0) {
+		return NULL;
+	}
+
+	json_sink_t sink = { json__file_write, json__file_close, fp };
+	json_writer_t* writer = json_writer_open(&sink);
+	if (writer == NULL) JSON_FCLOSE(fp);
+	return writer;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+static int json__fd_write(void* user, const void* data, size_t size)
+{
+	while (size > 0) {
+		ssize_t n = write((int)(intptr_t)user, data, size);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		data = (const uint8_t*)data + n;
+		size -= (size_t)n;
+	}
+	return 0;
+}
+
+json_writer_t* json_writer_fd(int fd)
+{
+	json_sink_t sink = { json__fd_write, NULL, (void*)(intptr_t)fd };
+	return json_writer_open(&sink);
+}
+#endif
+
+json_writer_t* json_writer_memory(void)
+{
+	json_sink_t sink = { NULL, NULL, NULL };
+	return json_writer_open(&sink);
+}
+
+const char* json_writer_get_buffer(json_writer_t* writer, size_t* size)
+{
+	*size = writer->pos;
+	return writer->buf;
+}
+
+int json_writer_flush(json_writer_t* writer)
+{
+	if (writer->sink.write != NULL && writer->pos > 0) {
+		if (!writer->failed && writer->sink.write(writer->sink.user, writer->buf, writer->pos) != 0) writer->failed = 1;
+		writer->pos = 0;
+	}
+	return writer->failed ? -1 : 0;
+}
+
+int json_writer_close(json_writer_t* writer)
+{
+	int result = json_writer_flush(writer);
+	if (writer->sink.close != NULL) writer->sink.close(writer->sink.user);
+	JSON_FREE(NULL, writer->buf);
+	JSON_FREE(NULL, writer);
+	return result;
+}
+
+// Make room for size bytes, a memory writer grows the buffer and other writers flush it.
+static int json__reserve(json_writer_t* writer, size_t size)
+{
+	if (writer->pos + size <= writer->capacity) return 1;
+	if (writer->sink.write != NULL) {
+		json_writer_flush(writer);
+		if (size <= writer->capacity) return 1;
+	}
+	size_t new_capacity = writer->capacity * 2;
+	while (new_capacity < writer->pos + size) new_capacity *= 2;
+	char* new_buf = (char*)JSON_REALLOC(NULL, writer->buf, new_capacity);
+	if (new_buf == NULL) {
+		fprintf(stderr, "PANIC failed to allocate memory for json_writer_t buffer!");
+		exit(-1);
+	}
+	writer->buf = new_buf;
+	writer->capacity = new_capacity;
+	return 1;
+}
+
+static void json__write(json_writer_t* writer, const void* data, size_t size)
+{
+	if (writer->pos + size > writer->capacity) {
+		// Large blocks go straight to the sink.
+		if (writer->sink.write != NULL && size >= writer->capacity) {
+			json_writer_flush(writer);
+			if (!writer->failed && writer->sink.write(writer->sink.user, data, size) != 0) writer->failed = 1;
+			return;
+		}
+		json__reserve(writer, size);
+	}
+	memcpy(writer->buf + writer->pos, data, size);
+	writer->pos += size;
+}
+
+static void json__write_char(json_writer_t* writer, char ch)
+{
+	if (writer->pos == writer->capacity) json__reserve(writer, 1);
+	writer->buf[writer->pos++] = ch;
+}
+
+static void json__write_newline(json_writer_t* writer)
+{
+	size_t size = 1 + (size_t)writer->level * (size_t)writer->indent;
+	json__reserve(writer, size);
+	writer->buf[writer->pos] = '\n';
+	memset(writer->buf + writer->pos + 1, ' ', size - 1);
+	writer->pos += size;
+}
+
+// Write the comma before the next item and, when indenting, the new line.
+static void json__write_separator(json_writer_t* writer)
+{
+	if (writer->comma) json__write_char(writer, ',');
+	if (writer->indent > 0 && !writer->name && writer->level > 0) json__write_newline(writer);
+	writer->name = 0;
+}
+
+static const char json__digits[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// Write the digits of value backwards from the end of buf and return the first digit.
+static char* json__utoa(char* end, uint64_t value)
+{
+	while (value >= 100) {
+		const char* d = &json__digits[(value % 100) * 2];
+		value /= 100;
+		*--end = d[1];
+		*--end = d[0];
+	}
+	if (value >= 10) {
+		const char* d = &json__digits[value * 2];
+		*--end = d[1];
+		*--end = d[0];
+	}
+	else *--end = (char)('0' + value);
+	return end;
+}
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define JSON__SSE2
+#endif
+
+static void json__write_escaped(json_writer_t* writer, const char* str, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t start = 0, i = 0;
+	json__write_char(writer, '\"');
+	while (i < len) {
+#ifdef JSON__SSE2
+		// Skip 16 bytes at a time that need no escaping: '"', '\\' and control characters.
+		const __m128i quote = _mm_set1_epi8('\"');
+		const __m128i backslash = _mm_set1_epi8('\\');
+		const __m128i control = _mm_set1_epi8(0x1F);
+		while (i + 16 <= len) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+			__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash));
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+			int mask = _mm_movemask_epi8(m);
+			if (mask != 0) {
+				i += (size_t)__builtin_ctz((unsigned)mask);
+				break;
+			}
+			i += 16;
+		}
+#endif
+		while (i < len) {
+			uint8_t ch = (uint8_t)str[i];
+			if (ch < 0x20 || ch == '\"' || ch == '\\') break;
+			i++;
+		}
+		json__write(writer, str + start, i - start);
+		if (i == len) break;
+
+		char esc[6] = { '\\', 0, '0', '0', 0, 0 };
+		uint8_t ch = (uint8_t)str[i];
+		size_t esc_len = 2;
+		switch (ch) {
+		case '\"': esc[1] = '\"'; break;
+		case '\\': esc[1] = '\\'; break;
+		case '\b': esc[1] = 'b'; break;
+		case '\f': esc[1] = 'f'; break;
+		case '\n': esc[1] = 'n'; break;
+		case '\r': esc[1] = 'r'; break;
+		case '\t': esc[1] = 't'; break;
+		default:
+			esc[1] = 'u';
+			esc[4] = hex[ch >> 4];
+			esc[5] = hex[ch & 0xF];
+			esc_len = 6;
+		}
+		json__write(writer, esc, esc_len);
+		start = ++i;
+	}
+	json__write_char(writer, '\"');
+}
+
+/* Grisu3 by Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with
+*  Integers". It produces the shortest digits that read back to the same double, or gives up
+*  when the error of its 64-bit arithmetic could change the result. That happens for about
+*  0.5% of all doubles, json__shortest_digits() then finds the digits with the C library.
+*/
+typedef struct {
+	uint64_t f;
+	int e;
+} json__diyfp_t;
+
+static const uint64_t json__cached_powers_f[] = {
+	0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76, 0xcf42894a5dce35ea,
+	0x9a6bb0aa55653b2d, 0xe61acf033d1a45df, 0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f,
+	0xbe5691ef416bd60c, 0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+	0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57, 0xc21094364dfb5637,
+	0x9096ea6f3848984f, 0xd77485cb25823ac7, 0xa086cfcd97bf97f4, 0xef340a98172aace5,
+	0xb23867fb2a35b28e, 0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+	0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126, 0xb5b5ada8aaff80b8,
+	0x87625f056c7c4a8b, 0xc9bcff6034c13053, 0x964e858c91ba2655, 0xdff9772470297ebd,
+	0xa6dfbd9fb8e5b88f, 0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+	0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06, 0xaa242499697392d3,
+	0xfd87b5f28300ca0e, 0xbce5086492111aeb, 0x8cbccc096f5088cc, 0xd1b71758e219652c,
+	0x9c40000000000000, 0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+	0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068, 0x9f4f2726179a2245,
+	0xed63a231d4c4fb27, 0xb0de65388cc8ada8, 0x83c7088e1aab65db, 0xc45d1df942711d9a,
+	0x924d692ca61be758, 0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+	0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d, 0x952ab45cfa97a0b3,
+	0xde469fbd99a05fe3, 0xa59bc234db398c25, 0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece,
+	0x88fcf317f22241e2, 0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+	0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410, 0x8bab8eefb6409c1a,
+	0xd01fef10a657842c, 0x9b10a4e5e9913129, 0xe7109bfba19c0c9d, 0xac2820d9623bf429,
+	0x80444b5e7aa7cf85, 0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+	0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b
+};
+
+static const int16_t json__cached_powers_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+	-954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+	-688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+	-422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+	-157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+	109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+	641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+	907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const uint64_t json__pow10[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+	1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+	1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static json__diyfp_t json__diyfp_mul(json__diyfp_t x, json__diyfp_t y)
+{
+	const uint64_t m32 = 0xFFFFFFFFu;
+	uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+	uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32) + (1U << 31);
+	json__diyfp_t r = { ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64 };
+	return r;
+}
+
+static json__diyfp_t json__diyfp_normalize(json__diyfp_t x)
+{
+	while (!(x.f & 0x8000000000000000ULL)) {
+		x.f <<= 1;
+		x.e--;
+	}
+	return x;
+}
+
+// Move the last digit towards w while that stays inside the unsafe interval. Returns 0 when the
+// rounding error (unit) makes it uncertain that the digits are the closest or inside the interval.
+static int json__grisu_round(char* buf, int len, uint64_t too_high_w, uint64_t unsafe, uint64_t rest, uint64_t ten_kappa, uint64_t unit)
+{
+	uint64_t small = too_high_w - unit, big = too_high_w + unit;
+	while (rest < small && unsafe - rest >= ten_kappa && (rest + ten_kappa < small || small - rest >= rest + ten_kappa - small)) {
+		buf[len - 1]--;
+		rest += ten_kappa;
+	}
+	if (rest < big && unsafe - rest >= ten_kappa && (rest + ten_kappa < big || big - rest > rest + ten_kappa - big)) return 0;
+	return 2 * unit <= rest && rest <= unsafe - 4 * unit;
+}
+
+// Returns the number of digits in buf, the value is digits * 10^k, or 0 when Grisu3 gives up.
+static int json__grisu3(double value, char* buf, int* k)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(double));
+	int biased_e = (int)((bits >> 52) & 0x7FF);
+	uint64_t significand = bits & 0xFFFFFFFFFFFFFULL;
+	json__diyfp_t v;
+	if (biased_e != 0) {
+		v.f = significand + 0x10000000000000ULL;
+		v.e = biased_e - 1075;
+	}
+	else {
+		v.f = significand;
+		v.e = -1074;
+	}
+
+	// Boundaries m- and m+ of the interval of values that read back as value.
+	json__diyfp_t wp = { (v.f << 1) + 1, v.e - 1 };
+	while (!(wp.f & (0x10000000000000ULL << 1))) {
+		wp.f <<= 1;
+		wp.e--;
+	}
+	wp.f <<= 10;
+	wp.e -= 10;
+	json__diyfp_t wm = { (v.f << 1) - 1, v.e - 1 };
+	if (v.f == 0x10000000000000ULL && biased_e > 1) { // The lower boundary is closer at a power of two
+		wm.f = (v.f << 2) - 1;
+		wm.e = v.e - 2;
+	}
+	wm.f <<= wm.e - wp.e;
+	wm.e = wp.e;
+
+	// Cached power of ten c so that the product with wp has its exponent in [-60, -32].
+	double dk = (-61 - wp.e) * 0.30102999566398114 + 347;
+	int ki = (int)dk;
+	if (dk - ki > 0.0) ki++;
+	unsigned index = (unsigned)((ki >> 3) + 1);
+	*k = -(-348 + (int)(index << 3));
+	json__diyfp_t c = { json__cached_powers_f[index], json__cached_powers_e[index] };
+
+	json__diyfp_t w = json__diyfp_mul(json__diyfp_normalize(v), c);
+	wp = json__diyfp_mul(wp, c);
+	wm = json__diyfp_mul(wm, c);
+
+	// The products are off by less than one unit, generate the digits of wp + unit until the rest
+	// is inside the unsafe interval (wm - unit, wp + unit).
+	uint64_t unit = 1;
+	uint64_t too_high = wp.f + unit;
+	uint64_t unsafe = too_high - (wm.f - unit);
+	uint64_t too_high_w = too_high - w.f;
+	int one_e = -wp.e;
+	uint64_t one_f = 1ULL << one_e;
+	uint32_t p1 = (uint32_t)(too_high >> one_e);
+	uint64_t p2 = too_high & (one_f - 1);
+	int kappa = 1, len = 0;
+	while (kappa < 10 && p1 >= json__pow10[kappa]) kappa++;
+
+	while (kappa > 0) {
+		uint32_t d = (uint32_t)(p1 / json__pow10[kappa - 1]);
+		p1 = (uint32_t)(p1 % json__pow10[kappa - 1]);
+		if (d || len) buf[len++] = (char)('0' + d);
+		kappa--;
+		uint64_t rest = ((uint64_t)p1 << one_e) + p2;
+		if (rest < unsafe) {
+			*k += kappa;
+			return json__grisu_round(buf, len, too_high_w, unsafe, rest, json__pow10[kappa] << one_e, unit) ? len : 0;
+		}
+	}
+	for (;;) {
+		p2 *= 10;
+		unit *= 10;
+		unsafe *= 10;
+		char d = (char)(p2 >> one_e);
+		if (d || len) buf[len++] = (char)('0' + d);
+		p2 &= one_f - 1;
+		kappa--;
+		if (p2 < unsafe) {
+			*k += kappa;
+			return json__grisu_round(buf, len, too_high_w * unit, unsafe, p2, one_f, unit) ? len : 0;
+		}
+	}
+}
+
+// Write value with n significant digits to str and return 1 if it reads back as value. The
+// interval below a power of two is half as wide as above it, there the next larger n-digit number
+// can read back when the rounded can not.
+static int json__round_trip(double value, int n, int power_of_two, char* str, size_t size)
+{
+	snprintf(str, size, "%.*e", n - 1, value);
+	if (strtod(str, NULL) == value) return 1;
+	if (!power_of_two) return 0;
+
+	// Add one to the last digit, the decimal point is left as the locale wrote it.
+	char* e = strchr(str, 'e');
+	char* p = e - 1;
+	for (; p >= str && (*p == '9' || *p < '0' || *p > '9'); p--) {
+		if (*p == '9') *p = '0';
+	}
+	if (p >= str) (*p)++;
+	else {
+		str[0] = '1'; // 9.99e5 -> 1.00e6
+		snprintf(e, size - (size_t)(e - str), "e%d", atoi(e + 1) + 1);
+	}
+	return strtod(str, NULL) == value;
+}
+
+// The shortest digits that read back as value, for the doubles that Grisu3 gives up on. If n
+// digits read back so do n + 1, the number of digits is found with a binary search in 1..17.
+static int json__shortest_digits(double value, char* buf, int* k)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(double));
+	int power_of_two = (bits & 0xFFFFFFFFFFFFFULL) == 0 && (bits >> 52) > 1;
+	char str[40];
+	int lo = 1, hi = 17;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (json__round_trip(value, mid, power_of_two, str, sizeof(str))) hi = mid;
+		else lo = mid + 1;
+	}
+	json__round_trip(value, lo, power_of_two, str, sizeof(str));
+
+	const char* e = strchr(str, 'e');
+	int len = 0;
+	for (const char* p = str; p < e; p++) {
+		if (*p >= '0' && *p <= '9') buf[len++] = *p;
+	}
+	while (len > 1 && buf[len - 1] == '0') len--;
+	*k = atoi(e + 1) - (len - 1);
+	return len;
+}
+
+// Format the digits in buf, the value is digits * 10^k, buf must have room for 32 chars.
+static int json__format_double(char* buf, int len, int k)
+{
+	int kk = len + k;
+	if (k >= 0 && kk <= 21) {
+		// 1234e7 -> 12340000000.0
+		for (int i = len; i < kk; i++) buf[i] = '0';
+		buf[kk] = '.';
+		buf[kk + 1] = '0';
+		return kk + 2;
+	}
+	else if (kk > 0 && kk <= 21) {
+		// 1234e-2 -> 12.34
+		memmove(&buf[kk + 1], &buf[kk], (size_t)(len - kk));
+		buf[kk] = '.';
+		return len + 1;
+	}
+	else if (kk > -6 && kk <= 0) {
+		// 1234e-6 -> 0.001234
+		int offset = 2 - kk;
+		memmove(&buf[offset], &buf[0], (size_t)len);
+		buf[0] = '0';
+		buf[1] = '.';
+		for (int i = 2; i < offset; i++) buf[i] = '0';
+		return len + offset;
+	}
+	else {
+		// 1234e30 -> 1.234e33
+		int pos = 1;
+		if (len > 1) {
+			memmove(&buf[2], &buf[1], (size_t)(len - 1));
+			buf[1] = '.';
+			pos = len + 1;
+		}
+		buf[pos++] = 'e';
+		int exp = kk - 1;
+		if (exp < 0) {
+			buf[pos++] = '-';
+			exp = -exp;
+		}
+		char tmp[8];
+		char* end = tmp + sizeof(tmp);
+		char* start = json__utoa(end, (uint64_t)exp);
+		memcpy(&buf[pos], start, (size_t)(end - start));
+		return pos + (int)(end - start);
+	}
+}
+
+static void json__write_start(json_writer_t* writer, char ch)
+{
+	json__write_separator(writer);
+	json__write_char(writer, ch);
+	writer->level++;
+	writer->comma = 0;
+}
+
+static void json__write_end(json_writer_t* writer, char ch)
+{
+	writer->level--;
+	if (writer->indent > 0 && writer->comma) json__write_newline(writer);
+	json__write_char(writer, ch);
+	writer->comma = 1;
+}
+
+void json_write_start_object(json_writer_t* writer)
+{
+	json__write_start(writer, '{');
+}
+
+void json_write_end_object(json_writer_t* writer)
+{
+	json__write_end(writer, '}');
+}
+
+void json_write_start_array(json_writer_t* writer)
+{
+	json__write_start(writer, '[');
+}
+
+void json_write_end_array(json_writer_t* writer)
+{
+	json__write_end(writer, ']');
+}
+
+// Write a name that is already quoted and escaped.
+static void json__write_raw_name(json_writer_t* writer, const void* name, size_t len)
+{
+	json__write_separator(writer);
+	json__write(writer, name, len);
+	if (writer->indent > 0) json__write(writer, ": ", 2);
+	else json__write_char(writer, ':');
+	writer->comma = 0;
+	writer->name = 1;
+}
+
+void json_write_name_n(json_writer_t* writer, const char* name, size_t len)
+{
+	json__write_separator(writer);
+	json__write_escaped(writer, name, len);
+	if (writer->indent > 0) json__write(writer, ": ", 2);
+	else json__write_char(writer, ':');
+	writer->comma = 0;
+	writer->name = 1;
+}
+
+void json_write_name(json_writer_t* writer, const char* name)
+{
+	json_write_name_n(writer, name, json__strlen(name));
+}
+
+void json_write_string_n(json_writer_t* writer, const char* str, size_t len)
+{
+	json__write_separator(writer);
+	json__write_escaped(writer, str, len);
+	writer->comma = 1;
+}
+
+void json_write_string(json_writer_t* writer, const char* str)
+{
+	json_write_string_n(writer, str, json__strlen(str));
+}
+
+void json_write_uint64(json_writer_t* writer, uint64_t value)
+{
+	char buf[24];
+	char* start = json__utoa(buf + sizeof(buf), value);
+	json__write_separator(writer);
+	json__write(writer, start, (size_t)(buf + sizeof(buf) - start));
+	writer->comma = 1;
+}
+
+void json_write_int64(json_writer_t* writer, int64_t value)
+{
+	char buf[24];
+	char* start = json__utoa(buf + sizeof(buf), value < 0 ? 0 - (uint64_t)value : (uint64_t)value);
+	if (value < 0) *--start = '-';
+	json__write_separator(writer);
+	json__write(writer, start, (size_t)(buf + sizeof(buf) - start));
+	writer->comma = 1;
+}
+
+void json_write_double(json_writer_t* writer, double value)
+{
+	char buf[40];
+	int len;
+	if (value != value || value - value != 0.0) { // NaN or infinity
+		json_write_null(writer);
+		return;
+	}
+	char* p = buf;
+	if (value < 0 || (value == 0.0 && 1.0 / value < 0)) {
+		*p++ = '-';
+		value = -value;
+	}
+	if (value == 0.0) {
+		memcpy(p, "0.0", 3);
+		len = 3 + (int)(p - buf);
+	}
+	else {
+		int k;
+		len = json__grisu3(value, p, &k);
+		if (len == 0) len = json__shortest_digits(value, p, &k);
+		len = json__format_double(p, len, k) + (int)(p - buf);
+	}
+	json__write_separator(writer);
+	json__write(writer, buf, (size_t)len);
+	writer->comma = 1;
+}
+
+void json_write_boolean(json_writer_t* writer, int value)
+{
+	json__write_separator(writer);
+	if (value) json__write(writer, "true", 4);
+	else json__write(writer, "false", 5);
+	writer->comma = 1;
+}
+
+void json_write_null(json_writer_t* writer)
+{
+	json__write_separator(writer);
+	json__write(writer, "null", 4);
+	writer->comma = 1;
+}
+
+void json_write_raw(json_writer_t* writer, const char* json, size_t len)
+{
+	json__write_separator(writer);
+	json__write(writer, json, len);
+	writer->comma = 1;
+}
+
+void json_writer_set_indent(json_writer_t* writer, int indent)
+{
+	writer->indent = indent;
+}
+
+json_token_t json_minify(json_t* src, json_writer_t* dst)
+{
+	// A schema needs the decoded names and strings.
+	src->raw = src->schema == NULL;
+	for (;;) {
+		json_token_t tok = json_next_token(src);
+		switch (tok) {
+		case JSON_START_OBJECT: json_write_start_object(dst); break;
+		case JSON_END_OBJECT: json_write_end_object(dst); break;
+		case JSON_START_ARRAY: json_write_start_array(dst); break;
+		case JSON_END_ARRAY: json_write_end_array(dst); break;
+		case JSON_NAME:
+			if (src->raw) json__write_raw_name(dst, src->mark, src->span_len);
+			else json_write_name_n(dst, json_get_name(src), json_get_length(src));
+			break;
+		case JSON_STRING:
+			if (src->raw) json_write_raw(dst, (const char*)src->mark, src->span_len);
+			else json_write_string_n(dst, json_get_value(src), json_get_length(src));
+			break;
+		case JSON_INT64: case JSON_UINT64: case JSON_DOUBLE: case JSON_BOOLEAN: case JSON_NULL:
+			json_write_raw(dst, json_get_value(src), json_get_length(src));
+			break;
+		case JSON_END_DOCUMENT:
+			if (dst->indent > 0) json__write_char(dst, '\n');
+			return json_writer_flush(dst) == 0 ? JSON_END_DOCUMENT : JSON_ERROR;
+		default:
+			return tok;
+		}
+		if (dst->failed) return JSON_ERROR;
+	}
+}
+
+json_token_t json_pretty(json_t* src, json_writer_t* dst, int indent)
+{
+	json_writer_set_indent(dst, indent);
+	return json_minify(src, dst);
+}
+
+json_token_t json_capture_raw(json_t* json, const char** raw, size_t* len)
+{
+	json_token_t tok;
+	if (json->capture == NULL) {
+		if (json->lc != json__t2 && json->lc != json__t9) return JSON_ERROR;
+		// The '{' or '[' is the current token, json->buf_end is at json->offset in the input.
+		json->capture = json->buf_end - (json->offset - json->tok_offset);
+		json->capture_level = json->level;
+		// A schema needs the decoded names and strings.
+		json->raw = json->schema == NULL;
+	}
+	for (;;) {
+		tok = json_next_token(json);
+		if (tok == JSON_WOULD_BLOCK) return tok;
+		if (tok == JSON_ERROR || ((tok == JSON_END_OBJECT || tok == JSON_END_ARRAY) && json->level == json->capture_level)) break;
+	}
+	if (tok != JSON_ERROR) {
+		*raw = (const char*)json->capture;
+		*len = (size_t)(json->buf_pos - json->capture);
+	}
+	json->capture = NULL;
+	json->raw = 0;
+	return tok;
+}
+
+struct json__index_entry {
+	uint64_t offset;
+	int64_t row, col;
+};
+
+struct json__index {
+	uint64_t stride, count;
+	size_t size, capacity;
+	struct json__index_entry* entries;
+};
+
+static json_index_t* json__index_new(uint64_t stride)
+{
+	json_index_t* index = (json_index_t*)JSON_REALLOC(NULL, NULL, sizeof(json_index_t));
+	if (index == NULL) {
+		fprintf(stderr, "PANIC: Failed to allocate memory for json index.");
+		exit(-1);
+	}
+	index->stride = stride;
+	index->count = 0;
+	index->size = 0;
+	index->capacity = 0;
+	index->entries = NULL;
+	return index;
+}
+
+static void json__index_push(json_index_t* index, uint64_t offset, int64_t row, int64_t col)
+{
+	if (index->size == index->capacity) {
+		size_t new_capacity = index->capacity == 0 ? 256 : index->capacity * 2;
+		struct json__index_entry* new_entries = (struct json__index_entry*)JSON_REALLOC(NULL, index->entries, new_capacity * sizeof(struct json__index_entry));
+		if (new_entries == NULL) {
+			fprintf(stderr, "PANIC: Failed to allocate memory for json index.");
+			exit(-1);
+		}
+		index->entries = new_entries;
+		index->capacity = new_capacity;
+	}
+	index->entries[index->size].offset = offset;
+	index->entries[index->size].row = row;
+	index->entries[index->size].col = col;
+	index->size++;
+}
+
+// Read the tokens of one element, the next token is the first of the element.
+static int json__skip_element(json_t* json)
+{
+	int depth = 0;
+	do {
+		switch (json_next_token(json)) {
+		case JSON_START_OBJECT: case JSON_START_ARRAY: depth++; break;
+		case JSON_END_OBJECT: case JSON_END_ARRAY: depth--; break;
+		case JSON_ERROR: case JSON_WOULD_BLOCK: case JSON_END_DOCUMENT: return -1;
+		default: break;
+		}
+	} while (depth > 0);
+	return 0;
+}
+
+json_index_t* json_index_build(json_t* json, uint64_t stride)
+{
+	if (stride == 0 || json_next_token(json) != JSON_START_ARRAY) return NULL;
+
+	json_index_t* index = json__index_new(stride);
+	int depth = 0;
+	for (;;) {
+		json_token_t tok = json_next_token(json);
+		if (tok == JSON_ERROR || tok == JSON_WOULD_BLOCK || tok == JSON_END_DOCUMENT) {
+			json_index_free(index);
+			return NULL;
+		}
+		if (depth == 0) {
+			if (tok == JSON_END_ARRAY) break;
+			if (index->count % stride == 0) json__index_push(index, json->tok_offset, json->tok_row, json->tok_col);
+			index->count++;
+		}
+		if (tok == JSON_START_OBJECT || tok == JSON_START_ARRAY) depth++;
+		else if (tok == JSON_END_OBJECT || tok == JSON_END_ARRAY) depth--;
+	}
+	if (json_next_token(json) != JSON_END_DOCUMENT) {
+		json_index_free(index);
+		return NULL;
+	}
+	return index;
+}
+
+int json_index_save(const json_index_t* index, const char* filename)
+{
+	json_writer_t* writer = json_writer_fopen(filename);
+	if (writer == NULL) return -1;
+
+	json_write_start_object(writer);
+	json_write_name(writer, "stride");
+	json_write_uint64(writer, index->stride);
+	json_write_name(writer, "count");
+	json_write_uint64(writer, index->count);
+	json_write_name(writer, "entries");
+	json_write_start_array(writer);
+	for (size_t i = 0; i < index->size; i++) {
+		json_write_start_array(writer);
+		json_write_uint64(writer, index->entries[i].offset);
+		json_write_int64(writer, index->entries[i].row);
+		json_write_int64(writer, index->entries[i].col);
+		json_write_end_array(writer);
+	}
+	json_write_end_array(writer);
+	json_write_end_object(writer);
+	return json_writer_close(writer);
+}
+
+json_index_t* json_index_load(const char* filename)
+{
+	json_t* json = json_fopen(filename);
+	if (json == NULL) return NULL;
+
+	// key is 1 for stride, 2 for count and 3 for entries.
+	json_index_t* index = json__index_new(0);
+	int depth = 0, key = 0, field = 0, valid = 1;
+	uint64_t entry[3];
+	json_token_t tok;
+	while (valid && (tok = json_next_token(json)) != JSON_END_DOCUMENT) {
+		switch (tok) {
+		case JSON_START_OBJECT: case JSON_START_ARRAY:
+			depth++;
+			field = 0;
+			break;
+		case JSON_END_ARRAY:
+			if (depth == 3 && key == 3) {
+				if (field == 3) json__index_push(index, entry[0], (int64_t)entry[1], (int64_t)entry[2]);
+				else valid = 0;
+			}
+			depth--;
+			break;
+		case JSON_END_OBJECT:
+			depth--;
+			break;
+		case JSON_NAME: {
+			const char* name = json_get_name(json);
+			key = depth != 1 ? 0 : strcmp(name, "stride") == 0 ? 1 : strcmp(name, "count") == 0 ? 2 : strcmp(name, "entries") == 0 ? 3 : 0;
+			break;
+		}
+		case JSON_INT64: case JSON_UINT64: {
+			uint64_t value = 0;
+			for (const char* p = json_get_value(json); *p >= '0' && *p <= '9'; p++) value = value * 10 + (uint64_t)(*p - '0');
+			if (depth == 1 && key == 1) index->stride = value;
+			else if (depth == 1 && key == 2) index->count = value;
+			else if (depth == 3 && key == 3 && field < 3) entry[field++] = value;
+			else valid = 0;
+			break;
+		}
+		default:
+			valid = 0;
+			break;
+		}
+	}
+	json_close(json);
+
+	if (!valid || index->stride == 0 || index->size != (index->count + index->stride - 1) / index->stride) {
+		json_index_free(index);
+		return NULL;
+	}
+	return index;
+}
+
+uint64_t json_index_count(const json_index_t* index)
+{
+	return index->count;
+}
+
+void json_index_free(json_index_t* index)
+{
+	if (index == NULL) return;
+	JSON_FREE(NULL, index->entries);
+	JSON_FREE(NULL, index);
+}
+
+int json_seek_element(json_t* json, const json_index_t* index, uint64_t n)
+{
+	if (n >= index->count) return -1;
+	const struct json__index_entry* entry = &index->entries[n / index->stride];
+
+	if (json->reader.read == NULL) { // Memory input, json->offset is the size
+		if (entry->offset >= json->offset) return -1;
+		json->buf_pos = json->buf_end - (json->offset - entry->offset);
+	}
+	else {
+		if (json->reader.seek == NULL || json->reader.seek(json->reader.user, entry->offset) != 0) return -1;
+		json->buf_pos = json->buf;
+		json->buf_end = json->buf;
+		json->offset = entry->offset;
+	}
+	json->input = JSON__INPUT_OK;
+	json->mark = NULL;
+	if (json->capture != NULL) { // An unfinished json_capture_raw()
+		json->capture = NULL;
+		json->raw = 0;
+	}
+
+	// The state inside the top-level array: the document waits for the array to return.
+	json->sc = 0;
+	json->calls[0] = json__c3;
+	json->call_depth = 1;
+	json->lc = json__resume;
+	json->level = 1;
+	json->row = entry->row;
+	json->col = entry->col - 1;
+	if (json->schema != NULL) { // The root schema describes the array
+		json->schema_stack[1].node = 1;
+		json->schema_stack[1].key = JSON__SCHEMA_NONE;
+		json->schema_stack[1].array = 1;
+		json->schema_stack[1].seen = 0;
+		json->schema_stack[1].count = n - n % index->stride;
+	}
+
+	for (uint64_t i = n % index->stride; i > 0; i--) {
+		if (json__skip_element(json) != 0) return -1;
+	}
+	return 0;
+}
+
+static void json__grow(void** buf, size_t* capacity, size_t size)
+{
+	if (size <= *capacity) return;
+	size_t new_capacity = *capacity < 64 ? 64 : *capacity * 2;
+	while (new_capacity < size) new_capacity *= 2;
+	void* new_buf = JSON_REALLOC(NULL, *buf, new_capacity);
+	if (new_buf == NULL) {
+		fprintf(stderr, "PANIC: Failed to allocate memory for json column.");
+		exit(-1);
+	}
+	*buf = new_buf;
+	*capacity = new_capacity;
+}
+
+// Store the validity of a row, row is either the last row or a new row after it.
+static void json__column_row(json_column_t* column, uint64_t row, int valid)
+{
+	uint8_t bit = (uint8_t)(1u << (row & 7));
+	if (row == column->length) {
+		size_t values = column->type == JSON_COLUMN_BOOLEAN ? (size_t)(row / 8 + 1) : column->type == JSON_COLUMN_STRING ? (size_t)(row + 2) * sizeof(int64_t) : (size_t)(row + 1) * 8;
+		json__grow((void**)&column->validity, &column->capacity[0], (size_t)(row / 8 + 1));
+		json__grow(&column->values, &column->capacity[1], values);
+		if (column->type == JSON_COLUMN_STRING && row == 0) ((int64_t*)column->values)[0] = 0;
+		if ((row & 7) == 0) { // Bits after the last row are zero
+			column->validity[row / 8] = 0;
+			if (column->type == JSON_COLUMN_BOOLEAN) ((uint8_t*)column->values)[row / 8] = 0;
+		}
+		column->length++;
+	}
+	else if ((column->validity[row / 8] & bit) == 0) column->null_count--;
+
+	if (valid) column->validity[row / 8] |= bit;
+	else {
+		column->validity[row / 8] &= (uint8_t)~bit;
+		column->null_count++;
+	}
+	if (column->type == JSON_COLUMN_STRING) column->data_size = (uint64_t)((int64_t*)column->values)[row];
+}
+
+static void json__column_set(json_column_t* column, uint64_t row, json_t* json, json_token_t tok)
+{
+	const char* value = json_get_value(json);
+	int valid = 0;
+	int64_t i = 0;
+	double d = 0.0;
+
+	switch (column->type) {
+	case JSON_COLUMN_INT64:
+		if (tok == JSON_INT64 || tok == JSON_UINT64) {
+			// Only values that fit in an int64_t, counting in negative numbers reaches INT64_MIN.
+			const char* p = value + (*value == '-');
+			valid = 1;
+			for (; *p >= '0' && *p <= '9' && valid; p++) {
+				valid = i >= (INT64_MIN + (*p - '0')) / 10;
+				if (valid) i = i * 10 - (*p - '0');
+			}
+			if (*value != '-') {
+				valid = valid && i != INT64_MIN;
+				if (valid) i = -i;
+			}
+		}
+		json__column_row(column, row, valid);
+		((int64_t*)column->values)[row] = valid ? i : 0;
+		break;
+	case JSON_COLUMN_DOUBLE:
+		valid = tok == JSON_INT64 || tok == JSON_UINT64 || tok == JSON_DOUBLE;
+		if (valid) d = json__parse_double(value);
+		json__column_row(column, row, valid);
+		((double*)column->values)[row] = d;
+		break;
+	case JSON_COLUMN_STRING: {
+		valid = tok == JSON_STRING;
+		json__column_row(column, row, valid);
+		size_t len = valid ? json_get_length(json) : 0;
+		json__grow((void**)&column->data, &column->capacity[2], (size_t)column->data_size + len);
+		if (len > 0) memcpy(column->data + column->data_size, value, len);
+		column->data_size += len;
+		((int64_t*)column->values)[row + 1] = (int64_t)column->data_size;
+		break;
+	}
+	case JSON_COLUMN_BOOLEAN:
+		valid = tok == JSON_BOOLEAN;
+		json__column_row(column, row, valid);
+		if (valid && *value == 't') ((uint8_t*)column->values)[row / 8] |= (uint8_t)(1u << (row & 7));
+		else ((uint8_t*)column->values)[row / 8] &= (uint8_t)~(1u << (row & 7));
+		break;
+	}
+}
+
+// Remove the rows from row and on, used to undo a record that is not complete.
+static void json__column_truncate(json_column_t* column, uint64_t row)
+{
+	for (uint64_t i = row; i < column->length; i++) {
+		if ((column->validity[i / 8] & (1u << (i & 7))) == 0) column->null_count--;
+	}
+	if (row < column->length) {
+		column->length = row;
+		if (column->type == JSON_COLUMN_STRING) column->data_size = (uint64_t)((int64_t*)column->values)[row];
+	}
+}
+
+int64_t json_extract_columns(json_t* json, json_column_t* columns, int count, int64_t max_rows)
+{
+	struct json__column_key { uint32_t hash; uint32_t len; };
+	struct json__column_key* keys = (struct json__column_key*)JSON_REALLOC(NULL, NULL, (size_t)(count > 0 ? count : 1) * sizeof(struct json__column_key));
+	if (keys == NULL) {
+		fprintf(stderr, "PANIC: Failed to allocate memory for json column.");
+		exit(-1);
+	}
+	for (int c = 0; c < count; c++) {
+		keys[c].len = (uint32_t)json__strlen(columns[c].name);
+		keys[c].hash = json__hash(columns[c].name, keys[c].len);
+	}
+
+	int64_t rows = 0;
+	int valid = 1;
+	while (valid && rows < max_rows) {
+		json_token_t tok = json_next_token(json);
+		if (tok == JSON_END_DOCUMENT) break;
+		if ((tok == JSON_START_ARRAY || tok == JSON_END_ARRAY) && json->level == 1) continue; // The array around the records
+		if (tok != JSON_START_OBJECT) {
+			valid = 0;
+			break;
+		}
+
+		uint64_t row = count > 0 ? columns[0].length : 0;
+		while (valid && (tok = json_next_token(json)) != JSON_END_OBJECT) {
+			if (tok != JSON_NAME) {
+				valid = 0;
+				break;
+			}
+			const char* name = json_get_name(json);
+			uint32_t len = (uint32_t)json_get_length(json);
+			uint32_t hash = json__hash(name, len);
+			int c = 0;
+			while (c < count && !(keys[c].hash == hash && keys[c].len == len && memcmp(columns[c].name, name, len) == 0)) c++;
+
+			tok = json_next_token(json);
+			if (tok == JSON_START_OBJECT || tok == JSON_START_ARRAY) {
+				valid = json__skip_value(json, tok);
+				tok = JSON_NULL;
+			}
+			else if (tok == JSON_ERROR || tok == JSON_WOULD_BLOCK || tok == JSON_END_DOCUMENT) valid = 0;
+			if (valid && c < count) json__column_set(&columns[c], row, json, tok);
+		}
+		for (int c = 0; c < count; c++) {
+			if (!valid) json__column_truncate(&columns[c], row);
+			else if (columns[c].length == row) json__column_set(&columns[c], row, json, JSON_NULL);
+		}
+		if (valid) rows++;
+	}
+	JSON_FREE(NULL, keys);
+	return valid ? rows : -1;
+}
+
+void json_columns_clear(json_column_t* columns, int count)
+{
+	for (int c = 0; c < count; c++) json__column_truncate(&columns[c], 0);
+}
+
+void json_columns_free(json_column_t* columns, int count)
+{
+	for (int c = 0; c < count; c++) {
+		JSON_FREE(NULL, columns[c].validity);
+		JSON_FREE(NULL, columns[c].values);
+		JSON_FREE(NULL, columns[c].data);
+		columns[c].validity = NULL;
+		columns[c].values = NULL;
+		columns[c].data = NULL;
+		memset(columns[c].capacity, 0, sizeof(columns[c].capacity));
+		columns[c].length = 0;
+		columns[c].null_count = 0;
+		columns[c].data_size = 0;
+	}
+}
+
+
 #undef STACK_SIZE
 #undef MAX_NESTING_LEVEL
 #undef LABEL
@@ -713,6 +3331,11 @@ void json_close(json_t* json)
 #undef CALL
 #undef RET
 #undef TOK
+#undef GETC
+#undef JSON__LABELS
+#undef JSON__LABEL_ENUM
+#undef JSON__LABEL_ADDRESS
+#undef JSON__THREADED
 #undef JSON_PARSER_IMPLEMENTATION
 
 #endif
@@ -0,0 +1,615 @@
+/* json_tokenizer.hpp - C++ helpers for json_tokenizer.h - Stefan Elmlund 2024
+*
+*  Header-only C++17 layer on top of json_tokenizer.h. Include it after json_tokenizer.h,
+*  in the file containing JSON_TOKENIZER_IMPLEMENTATION that must come first:
+*
+*    #define JSON_TOKENIZER_IMPLEMENTATION
+*    #include "json_tokenizer.h"
+*    #include "json_tokenizer.hpp"
+*
+*  TOKENIZER
+*
+*    json::tokenizer owns a json_t and closes it when it goes out of scope:
+*
+*      json::tokenizer json = json::tokenizer::open("sample.json");
+*      if (!json) ...
+*      for (json_token_t tok : json) {
+*        if (tok == JSON_NAME) std::string_view name = json.name();
+*      }
+*
+*    Iteration stops after JSON_END_DOCUMENT or the first JSON_ERROR. All members are
+*    inline calls to the C functions, the class is the size of a pointer.
+*
+*  ASYNC
+*
+*    With C++20 json::async_tokenizer reads from a non-blocking file descriptor and co_await
+*    next() suspends the coroutine until the reactor reports the file descriptor readable:
+*
+*      json::detached parse(int fd, json::poll_reactor& reactor) {
+*        json::async_tokenizer<json::poll_reactor> json(fd, reactor);
+*        for (json_token_t tok = co_await json.next(); tok != JSON_END_DOCUMENT && tok != JSON_ERROR; tok = co_await json.next()) ...
+*      }
+*
+*    The reactor is any type with: void wait_readable(int fd, void (*callback)(void*), void* user);
+*    that calls callback(user) once when fd is readable, e.g. a wrapper around epoll.
+*
+*  SCHEMA BINDING
+*
+*    Declare the fields of a struct once and let the compiler build a deserializer for it:
+*
+*      struct person_t { int age; std::string name; std::vector<std::string> tags; };
+*
+*      JSON_BIND(person_t,
+*        JSON_FIELD(age),
+*        JSON_FIELD(name),
+*        JSON_FIELD_NAMED(tags, "tagList"));
+*
+*      person_t person;
+*      if (!json::read(json, person)) ...   // json is a json_t* or a json::tokenizer
+*
+*    The input must be blocking, json::read() returns false on JSON_WOULD_BLOCK and the
+*    value can not be resumed.
+*
+*    Keys are dispatched through a hash table built at compile time, keys that are not
+*    declared are skipped and the order of the keys in the input does not matter.
+*    Integers, floating point numbers, bool, std::string, std::vector and other bound
+*    structs are supported. Other types are supported by specializing json::value_reader.
+*    Numbers are converted with std::from_chars, independent of the locale. Floating point
+*    std::from_chars needs GCC 11 or MSVC 2019 16.4.
+*
+*  LICENSE
+*
+*    See end of json_tokenizer.h for license information.
+*/
+
+#ifndef __JSON_TOKENIZER_HPP__
+#define __JSON_TOKENIZER_HPP__
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>) && (defined(__unix__) || defined(__APPLE__))
+#define JSON_TOKENIZER_HPP_ASYNC
+#include <cerrno>
+#include <coroutine>
+#include <exception>
+#include <poll.h>
+#endif
+
+#include "json_tokenizer.h"
+
+namespace json {
+
+/** @brief Move-only owner of a json_t with token iteration and typed accessors.
+*/
+class tokenizer {
+public:
+	class iterator {
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = json_token_t;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const json_token_t*;
+		using reference = const json_token_t&;
+
+		iterator() noexcept : json_(nullptr), tok_(JSON_END_DOCUMENT) {}
+		// A null json, e.g. a file that could not be opened, is the end.
+		explicit iterator(json_t* json) noexcept : json_(json), tok_(JSON_END_DOCUMENT) { if (json_ != nullptr) ++(*this); }
+
+		reference operator*() const noexcept { return tok_; }
+		pointer operator->() const noexcept { return &tok_; }
+
+		iterator& operator++() noexcept
+		{
+			if (tok_ == JSON_ERROR || (tok_ = json_next_token(json_)) == JSON_END_DOCUMENT) json_ = nullptr;
+			return *this;
+		}
+
+		void operator++(int) noexcept { ++(*this); }
+
+		bool operator==(const iterator& other) const noexcept { return json_ == other.json_; }
+		bool operator!=(const iterator& other) const noexcept { return json_ != other.json_; }
+
+	private:
+		json_t* json_;
+		json_token_t tok_;
+	};
+
+	tokenizer() noexcept : json_(nullptr) {}
+	explicit tokenizer(json_t* json) noexcept : json_(json) {}
+	tokenizer(tokenizer&& other) noexcept : json_(other.json_) { other.json_ = nullptr; }
+	tokenizer(const tokenizer&) = delete;
+	~tokenizer() { if (json_ != nullptr) json_close(json_); }
+
+	tokenizer& operator=(tokenizer&& other) noexcept
+	{
+		if (this != &other) reset(other.release());
+		return *this;
+	}
+	tokenizer& operator=(const tokenizer&) = delete;
+
+	/** @brief Open a json file, check the result with operator bool.
+	*/
+	static tokenizer open(const char* filename) noexcept { return tokenizer(json_fopen(filename)); }
+
+	explicit operator bool() const noexcept { return json_ != nullptr; }
+	json_t* get() const noexcept { return json_; }
+
+	json_t* release() noexcept
+	{
+		json_t* json = json_;
+		json_ = nullptr;
+		return json;
+	}
+
+	void reset(json_t* json = nullptr) noexcept
+	{
+		if (json_ != nullptr) json_close(json_);
+		json_ = json;
+	}
+
+	/** @brief Iterate over the remaining tokens.
+	*/
+	iterator begin() noexcept { return iterator(json_); }
+	iterator end() noexcept { return iterator(); }
+
+	json_token_t next() noexcept { return json_next_token(json_); }
+
+	/** @brief The name after a JSON_NAME token, empty if not applicable.
+	*/
+	std::string_view name() const noexcept { return view(json_get_name(json_)); }
+
+	/** @brief The text of the current value token, empty if not applicable.
+	*/
+	std::string_view value() const noexcept { return view(json_get_value(json_)); }
+
+	/** @brief The error message after a JSON_ERROR token, empty if not applicable.
+	*/
+	std::string_view error() const noexcept { return view(json_get_error(json_)); }
+
+	/** @brief The byte offset in the input of the current token.
+	*/
+	uint64_t offset() const noexcept { return json_get_offset(json_); }
+
+	/** @brief Read the object or array that was just started and return its source text, see json_capture_raw().
+	*   Empty on invalid input.
+	*/
+	std::string_view capture_raw() noexcept
+	{
+		const char* raw;
+		size_t len;
+		json_token_t tok = json_capture_raw(json_, &raw, &len);
+		return tok == JSON_END_OBJECT || tok == JSON_END_ARRAY ? std::string_view(raw, len) : std::string_view();
+	}
+
+	/** @brief Convert the current number token with std::from_chars, returns false if it is not a number
+	*   or does not fit in T.
+	*/
+	template<class T>
+	bool get(T& out) const noexcept
+	{
+		std::string_view str = value();
+		std::from_chars_result res = std::from_chars(str.data(), str.data() + str.size(), out);
+		return res.ec == std::errc() && res.ptr == str.data() + str.size();
+	}
+
+	bool get(bool& out) const noexcept
+	{
+		const char* str = json_get_value(json_);
+		if (str == nullptr || (str[0] != 't' && str[0] != 'f')) return false;
+		out = str[0] == 't';
+		return true;
+	}
+
+	int64_t get_int64() const noexcept { int64_t v = 0; get(v); return v; }
+	uint64_t get_uint64() const noexcept { uint64_t v = 0; get(v); return v; }
+	double get_double() const noexcept { double v = 0; get(v); return v; }
+	bool get_bool() const noexcept { bool v = false; get(v); return v; }
+
+private:
+	std::string_view view(const char* str) const noexcept
+	{
+		return str != nullptr ? std::string_view(str, json_get_length(json_)) : std::string_view();
+	}
+
+	json_t* json_;
+};
+
+#ifdef JSON_TOKENIZER_HPP_ASYNC
+
+/** @brief Return type for fire and forget coroutines.
+*/
+struct detached {
+	struct promise_type {
+		detached get_return_object() noexcept { return detached(); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+/** @brief A minimal poll() based reactor for async_tokenizer.
+*/
+class poll_reactor {
+public:
+	void wait_readable(int fd, void (*callback)(void*), void* user) { waiting_.push_back(waiter{ fd, callback, user }); }
+
+	/** @brief Dispatch callbacks until nothing is waiting.
+	*   @return false if poll() failed.
+	*/
+	bool run()
+	{
+		std::vector<pollfd> fds;
+		std::vector<waiter> ready;
+		while (!waiting_.empty()) {
+			fds.clear();
+			for (const waiter& w : waiting_) fds.push_back(pollfd{ w.fd, POLLIN, 0 });
+			if (::poll(fds.data(), (nfds_t)fds.size(), -1) < 0) {
+				if (errno == EINTR) continue;
+				return false;
+			}
+			ready.clear();
+			for (size_t i = fds.size(); i-- > 0;) {
+				if (fds[i].revents != 0) {
+					ready.push_back(waiting_[i]);
+					waiting_.erase(waiting_.begin() + i);
+				}
+			}
+			for (const waiter& w : ready) w.callback(w.user);
+		}
+		return true;
+	}
+
+private:
+	struct waiter {
+		int fd;
+		void (*callback)(void*);
+		void* user;
+	};
+	std::vector<waiter> waiting_;
+};
+
+/** @brief Tokenizer over a non-blocking file descriptor where next() is awaitable.
+*/
+template<class Reactor>
+class async_tokenizer : public tokenizer {
+public:
+	class next_awaiter {
+	public:
+		explicit next_awaiter(async_tokenizer* json) noexcept : json_(json), tok_(JSON_WOULD_BLOCK) {}
+
+		bool await_ready() noexcept { return (tok_ = json_next_token(json_->get())) != JSON_WOULD_BLOCK; }
+
+		void await_suspend(std::coroutine_handle<> handle) noexcept
+		{
+			handle_ = handle;
+			json_->reactor_->wait_readable(json_->fd_, &next_awaiter::readable, this);
+		}
+
+		json_token_t await_resume() const noexcept { return tok_; }
+
+	private:
+		static void readable(void* user)
+		{
+			next_awaiter* self = (next_awaiter*)user;
+			if ((self->tok_ = json_next_token(self->json_->get())) == JSON_WOULD_BLOCK) {
+				self->json_->reactor_->wait_readable(self->json_->fd_, &next_awaiter::readable, self);
+			}
+			else self->handle_.resume();
+		}
+
+		async_tokenizer* json_;
+		json_token_t tok_;
+		std::coroutine_handle<> handle_;
+	};
+
+	/** @brief The file descriptor should be non-blocking, it is not closed.
+	*/
+	async_tokenizer(int fd, Reactor& reactor) noexcept : tokenizer(json_open_fd(fd)), fd_(fd), reactor_(&reactor) {}
+
+	/** @brief Await the next token, never returns JSON_WOULD_BLOCK.
+	*/
+	next_awaiter next() noexcept { return next_awaiter(this); }
+
+private:
+	int fd_;
+	Reactor* reactor_;
+};
+
+#endif
+
+/** @brief Describe how a struct is read, specialize it with JSON_BIND.
+*/
+template<class T>
+struct binding;
+
+/** @brief Read a value of type T from the current token, specialize it to support more types.
+*
+*   A specialization must provide: static bool read(json_t* json, json_token_t tok, T& out);
+*   where tok is the current token. When it returns true all tokens of the value have been consumed.
+*   It must return false on JSON_WOULD_BLOCK, reading a value can not be resumed.
+*/
+template<class T, class Enable = void>
+struct value_reader;
+
+namespace detail {
+
+	constexpr uint32_t hash(const char* str, size_t len)
+	{
+		uint32_t h = 2166136261u;
+		for (size_t i = 0; i < len; i++) {
+			h = (h ^ (uint8_t)str[i]) * 16777619u;
+		}
+		return h;
+	}
+
+	template<class T, class = void>
+	struct has_binding : std::false_type {};
+
+	template<class T>
+	struct has_binding<T, std::void_t<decltype(binding<T>::fields())>> : std::true_type {};
+
+} // namespace detail
+
+/** @brief A field descriptor, create it with json::field() or the JSON_FIELD macros.
+*/
+template<class T, class M>
+struct field_t {
+	const char* name;
+	size_t length;
+	uint32_t hash;
+	M T::* member;
+};
+
+template<class T, class M, size_t N>
+constexpr field_t<T, M> field(const char (&name)[N], M T::* member)
+{
+	return field_t<T, M>{ name, N - 1, detail::hash(name, N - 1), member };
+}
+
+/** @brief Skip the value that starts with the current token, including nested objects and arrays.
+*   @param json Pointer to a json structure.
+*   @param tok The current token.
+*   @return true on success, false on JSON_ERROR, JSON_WOULD_BLOCK or if tok does not start a value.
+*/
+inline bool skip(json_t* json, json_token_t tok)
+{
+	switch (tok) {
+	case JSON_STRING: case JSON_INT64: case JSON_UINT64: case JSON_DOUBLE: case JSON_BOOLEAN: case JSON_NULL:
+		return true;
+	case JSON_START_OBJECT: case JSON_START_ARRAY:
+		break;
+	default:
+		return false;
+	}
+	for (int level = 1; level > 0;) {
+		switch (json_next_token(json)) {
+		case JSON_START_OBJECT: case JSON_START_ARRAY: level++; break;
+		case JSON_END_OBJECT: case JSON_END_ARRAY: level--; break;
+		case JSON_ERROR: case JSON_END_DOCUMENT: case JSON_WOULD_BLOCK: return false;
+		default: break;
+		}
+	}
+	return true;
+}
+
+namespace detail {
+
+	template<class T>
+	struct schema {
+		static constexpr auto fields = binding<T>::fields();
+		static constexpr size_t count = std::tuple_size<decltype(fields)>::value;
+
+		// Open addressing table, at least twice the number of fields and a power of two.
+		static constexpr size_t table_size()
+		{
+			size_t size = 4;
+			while (size < count * 2) size *= 2;
+			return size;
+		}
+
+		template<size_t... I>
+		static constexpr std::array<uint32_t, sizeof...(I)> make_hashes(std::index_sequence<I...>)
+		{
+			return { { std::get<I>(fields).hash... } };
+		}
+
+		template<size_t... I>
+		static constexpr std::array<size_t, sizeof...(I)> make_lengths(std::index_sequence<I...>)
+		{
+			return { { std::get<I>(fields).length... } };
+		}
+
+		template<size_t... I>
+		static constexpr std::array<const char*, sizeof...(I)> make_names(std::index_sequence<I...>)
+		{
+			return { { std::get<I>(fields).name... } };
+		}
+
+		static constexpr std::array<uint32_t, count> hashes = make_hashes(std::make_index_sequence<count>());
+		static constexpr std::array<size_t, count> lengths = make_lengths(std::make_index_sequence<count>());
+		static constexpr std::array<const char*, count> names = make_names(std::make_index_sequence<count>());
+
+		// Slot value is the field index + 1, 0 is an empty slot.
+		static constexpr std::array<uint8_t, table_size()> make_table()
+		{
+			std::array<uint8_t, table_size()> table{};
+			for (size_t i = 0; i < count; i++) {
+				size_t slot = hashes[i] & (table_size() - 1);
+				while (table[slot] != 0) slot = (slot + 1) & (table_size() - 1);
+				table[slot] = (uint8_t)(i + 1);
+			}
+			return table;
+		}
+
+		static constexpr std::array<uint8_t, table_size()> table = make_table();
+
+		static int lookup(const char* name, size_t len)
+		{
+			uint32_t h = hash(name, len);
+			for (size_t slot = h & (table_size() - 1); table[slot] != 0; slot = (slot + 1) & (table_size() - 1)) {
+				size_t i = table[slot] - 1;
+				if (hashes[i] == h && lengths[i] == len && std::memcmp(names[i], name, len) == 0) return (int)i;
+			}
+			return -1;
+		}
+
+		template<size_t I>
+		static bool read_field(json_t* json, json_token_t tok, T& out)
+		{
+			auto& member = out.*(std::get<I>(fields).member);
+			return value_reader<std::remove_reference_t<decltype(member)>>::read(json, tok, member);
+		}
+
+		using handler_t = bool (*)(json_t*, json_token_t, T&);
+
+		template<size_t... I>
+		static constexpr std::array<handler_t, sizeof...(I)> make_handlers(std::index_sequence<I...>)
+		{
+			return { { &read_field<I>... } };
+		}
+
+		static constexpr std::array<handler_t, count> handlers = make_handlers(std::make_index_sequence<count>());
+
+		static_assert(count < 256, "json::binding supports at most 255 fields.");
+	};
+
+} // namespace detail
+
+template<class T>
+struct value_reader<T, std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value>> {
+	static bool read(json_t* json, json_token_t tok, T& out)
+	{
+		if (tok != JSON_INT64 && tok != JSON_UINT64) return false;
+		const char* str = json_get_value(json);
+		const char* end = str + json_get_length(json);
+		std::from_chars_result res = std::from_chars(str, end, out);
+		return res.ec == std::errc() && res.ptr == end;
+	}
+};
+
+template<class T>
+struct value_reader<T, std::enable_if_t<std::is_floating_point<T>::value>> {
+	static bool read(json_t* json, json_token_t tok, T& out)
+	{
+		if (tok != JSON_INT64 && tok != JSON_UINT64 && tok != JSON_DOUBLE) return false;
+		const char* str = json_get_value(json);
+		const char* end = str + json_get_length(json);
+		std::from_chars_result res = std::from_chars(str, end, out);
+		return res.ec == std::errc() && res.ptr == end;
+	}
+};
+
+template<>
+struct value_reader<bool> {
+	static bool read(json_t* json, json_token_t tok, bool& out)
+	{
+		if (tok != JSON_BOOLEAN) return false;
+		out = json_get_value(json)[0] == 't';
+		return true;
+	}
+};
+
+template<>
+struct value_reader<std::string> {
+	static bool read(json_t* json, json_token_t tok, std::string& out)
+	{
+		if (tok != JSON_STRING) return false;
+		out.assign(json_get_value(json), json_get_length(json));
+		return true;
+	}
+};
+
+template<class E, class A>
+struct value_reader<std::vector<E, A>> {
+	static bool read(json_t* json, json_token_t tok, std::vector<E, A>& out)
+	{
+		if (tok != JSON_START_ARRAY) return false;
+		out.clear(); // Replace the elements like other values are replaced when out is reused
+		for (;;) {
+			tok = json_next_token(json);
+			if (tok == JSON_END_ARRAY) return true;
+			out.emplace_back();
+			if (!value_reader<E>::read(json, tok, out.back())) return false;
+		}
+	}
+};
+
+template<class T>
+struct value_reader<T, std::enable_if_t<detail::has_binding<T>::value>> {
+	static bool read(json_t* json, json_token_t tok, T& out)
+	{
+		using schema = detail::schema<T>;
+		if (tok != JSON_START_OBJECT) return false;
+		for (;;) {
+			tok = json_next_token(json);
+			if (tok == JSON_END_OBJECT) return true;
+			if (tok != JSON_NAME) return false;
+			int i = schema::lookup(json_get_name(json), json_get_length(json));
+			tok = json_next_token(json);
+			if (i < 0) {
+				if (!skip(json, tok)) return false;
+			}
+			else if (!schema::handlers[i](json, tok, out)) return false;
+		}
+	}
+};
+
+/** @brief Read a value from the current token.
+*   @param json Pointer to a json structure.
+*   @param tok The current token, the first token of the value.
+*   @param out The value to fill in.
+*   @return true on success, false if the input does not match T, on JSON_ERROR or on JSON_WOULD_BLOCK.
+*/
+template<class T>
+bool read(json_t* json, json_token_t tok, T& out)
+{
+	return value_reader<T>::read(json, tok, out);
+}
+
+/** @brief Read the next token and the value it starts.
+*   @param json Pointer to a json structure.
+*   @param out The value to fill in.
+*   @return true on success, false if the input does not match T, on JSON_ERROR or on JSON_WOULD_BLOCK.
+*/
+template<class T>
+bool read(json_t* json, T& out)
+{
+	return value_reader<T>::read(json, json_next_token(json), out);
+}
+
+template<class T>
+bool read(tokenizer& json, json_token_t tok, T& out)
+{
+	return value_reader<T>::read(json.get(), tok, out);
+}
+
+template<class T>
+bool read(tokenizer& json, T& out)
+{
+	return value_reader<T>::read(json.get(), json.next(), out);
+}
+
+} // namespace json
+
+#define JSON_FIELD(member) ::json::field(#member, &json_bound_type::member)
+#define JSON_FIELD_NAMED(member, name) ::json::field(name, &json_bound_type::member)
+#define JSON_BIND(type, ...) \
+	template<> struct json::binding<type> { \
+		using json_bound_type = type; \
+		static constexpr auto fields() { return std::make_tuple(__VA_ARGS__); } \
+	}
+
+#endif
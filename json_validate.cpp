@@ -0,0 +1,261 @@
+// Validate many json files in parallel.
+//
+//     json_validate [-j threads] [-q] [--stream] [--schema file] <file|directory|glob>...
+//
+// Directories are searched recursively for *.json files (and *.ndjson, *.jsonl with --stream). A glob
+// matches '*' and '?' within a directory and '**' across directories, e.g. "data/**/*.json".
+// The files are validated on a work-stealing pool of threads, the largest first, and each thread
+// reuses one tokenizer. Prints PASS or FAIL with the error for each file and the total throughput.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#define JSON_TOKENIZER_IMPLEMENTATION
+#include "json_tokenizer.h"
+
+namespace fs = std::filesystem;
+
+struct file_t {
+	std::string path;
+	uint64_t size;
+};
+
+struct options_t {
+	int threads = 0;
+	bool quiet = false;
+	bool stream = false;
+	const json_schema_t* schema = nullptr;
+};
+
+// The files of one worker, it takes the largest from the front and others steal the smallest from the back.
+struct queue_t {
+	std::mutex mutex;
+	std::deque<size_t> files;
+};
+
+struct batch_t {
+	const options_t* options;
+	const std::vector<file_t>* files;
+	std::vector<queue_t> queues;
+	std::mutex output;
+	std::atomic<uint64_t> passed{0}, failed{0}, unreadable{0}, bytes{0};
+
+	batch_t(const options_t* options, const std::vector<file_t>* files, size_t threads) : options(options), files(files), queues(threads) {}
+};
+
+// Match '*' and '?' within a path component and '**' across components.
+static bool glob_match(const char* pattern, const char* path)
+{
+	for (; *pattern != '\0'; pattern++, path++) {
+		if (pattern[0] == '*' && pattern[1] == '*') {
+			pattern += 2;
+			bool dirs = *pattern == '/'; // "**/" matches whole directories, also none
+			if (dirs) pattern++;
+			for (const char* p = path;; p++) {
+				if ((!dirs || p == path || p[-1] == '/') && glob_match(pattern, p)) return true;
+				if (*p == '\0') return false;
+			}
+		}
+		if (*pattern == '*') {
+			for (;; path++) {
+				if (glob_match(pattern + 1, path)) return true;
+				if (*path == '\0' || *path == '/') return false;
+			}
+		}
+		if (*path == '\0' || (*pattern == '?' ? *path == '/' : *pattern != *path)) return false;
+	}
+	return *path == '\0';
+}
+
+static bool has_extension(const fs::path& path, bool stream)
+{
+	std::string ext = path.extension().string();
+	return ext == ".json" || (stream && (ext == ".ndjson" || ext == ".jsonl"));
+}
+
+static void add_file(std::vector<file_t>& files, const fs::path& path)
+{
+	std::error_code ec;
+	uint64_t size = fs::file_size(path, ec);
+	files.push_back({ path.lexically_normal().generic_string(), ec ? 0 : size });
+}
+
+// Add the files of a directory, or the files below the fixed part of a glob that match it.
+// Directories deeper than max_depth are not searched, -1 is unlimited.
+static void add_tree(std::vector<file_t>& files, const fs::path& root, const std::string* pattern, int max_depth, bool stream)
+{
+	std::error_code ec;
+	fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec), end;
+	for (; !ec && it != end; it.increment(ec)) {
+		if (max_depth >= 0 && it.depth() >= max_depth && it->is_directory(ec)) it.disable_recursion_pending();
+		if (!it->is_regular_file(ec)) continue;
+		if (pattern != nullptr ? glob_match(pattern->c_str(), it->path().lexically_normal().generic_string().c_str()) : has_extension(it->path(), stream)) {
+			add_file(files, it->path());
+		}
+	}
+}
+
+static bool add_argument(std::vector<file_t>& files, const char* arg, bool stream)
+{
+	std::error_code ec;
+	std::string pattern = fs::path(arg).lexically_normal().generic_string();
+	if (pattern.find_first_of("*?") == std::string::npos) {
+		if (fs::is_directory(arg, ec)) add_tree(files, arg, nullptr, -1, stream);
+		else if (fs::is_regular_file(arg, ec)) add_file(files, arg);
+		else return false;
+		return true;
+	}
+
+	// The directories before the first component with a wildcard.
+	size_t wildcard = pattern.find_first_of("*?");
+	size_t slash = pattern.rfind('/', wildcard);
+	std::string root = slash == std::string::npos ? "." : slash == 0 ? "/" : pattern.substr(0, slash);
+	// Without "**" a glob can not match deeper than the number of directories after the root.
+	int max_depth = -1;
+	if (pattern.find("**") == std::string::npos) {
+		max_depth = (int)std::count(pattern.begin() + (slash == std::string::npos ? 0 : slash + 1), pattern.end(), '/');
+	}
+	if (fs::is_directory(root, ec)) add_tree(files, root, &pattern, max_depth, stream);
+	return true;
+}
+
+static void validate(batch_t& batch, json_t* json, const file_t& file)
+{
+	json_reader_t reader;
+	if (json_file_reader(&reader, file.path.c_str()) != 0) {
+		batch.unreadable++;
+		std::lock_guard<std::mutex> lock(batch.output);
+		printf("FAIL %s: Can not open the file.\n", file.path.c_str());
+		return;
+	}
+	json_reopen(json, &reader);
+	json_token_t tok;
+	while ((tok = json_next_token(json)) != JSON_END_DOCUMENT && tok != JSON_ERROR) {}
+	batch.bytes += file.size;
+	if (tok == JSON_ERROR) {
+		batch.failed++;
+		std::lock_guard<std::mutex> lock(batch.output);
+		printf("FAIL %s: %s (byte %llu)\n", file.path.c_str(), json_get_error(json), (unsigned long long)json_get_offset(json));
+	}
+	else {
+		batch.passed++;
+		if (batch.options->quiet) return;
+		std::lock_guard<std::mutex> lock(batch.output);
+		printf("PASS %s\n", file.path.c_str());
+	}
+}
+
+static bool take(queue_t& queue, size_t& index, bool steal)
+{
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.files.empty()) return false;
+	if (steal) {
+		index = queue.files.back();
+		queue.files.pop_back();
+	}
+	else {
+		index = queue.files.front();
+		queue.files.pop_front();
+	}
+	return true;
+}
+
+static void worker(batch_t& batch, size_t self)
+{
+	// A tokenizer without input, it is reopened for each file. It exits if it can not be allocated.
+	json_t* json = json_open_memory("", 0);
+	json_set_stream(json, batch.options->stream);
+	json_set_schema(json, batch.options->schema);
+
+	size_t count = batch.queues.size();
+	for (;;) {
+		size_t index;
+		bool found = take(batch.queues[self], index, false);
+		for (size_t i = 1; !found && i < count; i++) found = take(batch.queues[(self + i) % count], index, true);
+		if (!found) break; // No new work is added, all queues are empty
+		validate(batch, json, (*batch.files)[index]);
+	}
+	json_close(json);
+}
+
+static int usage()
+{
+	fprintf(stderr, "usage: json_validate [-j threads] [-q] [--stream] [--schema file] <file|directory|glob>...\n");
+	return 2;
+}
+
+int main(int argc, char* argv[])
+{
+	options_t options;
+	std::vector<file_t> files;
+	json_schema_t* schema = nullptr;
+	int status = 0;
+
+	if (argc < 2) return usage();
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) options.threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-q") == 0) options.quiet = true;
+		else if (strcmp(argv[i], "--stream") == 0) options.stream = true;
+		else if (strcmp(argv[i], "--schema") == 0 && i + 1 < argc) {
+			json_t* json = json_fopen(argv[++i]);
+			json_schema_free(schema);
+			schema = json != NULL ? json_schema_compile(json) : nullptr;
+			if (json != NULL) json_close(json);
+			if (schema == nullptr) {
+				fprintf(stderr, "Can not compile the schema %s\n", argv[i]);
+				return 2;
+			}
+		}
+		else if (argv[i][0] == '-' && argv[i][1] != '\0') return usage();
+	}
+	// The files are collected after the options, so --stream applies to all directories.
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--schema") == 0) i++;
+		else if (argv[i][0] != '-' && !add_argument(files, argv[i], options.stream)) {
+			fprintf(stderr, "No such file or directory: %s\n", argv[i]);
+			status = 2;
+		}
+	}
+	options.schema = schema;
+
+	std::sort(files.begin(), files.end(), [](const file_t& a, const file_t& b) { return a.path < b.path; });
+	files.erase(std::unique(files.begin(), files.end(), [](const file_t& a, const file_t& b) { return a.path == b.path; }), files.end());
+
+	// The largest files first, dealt round robin so every worker starts on a large one.
+	std::vector<size_t> order(files.size());
+	for (size_t i = 0; i < order.size(); i++) order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&files](size_t a, size_t b) { return files[a].size > files[b].size; });
+
+	size_t threads = options.threads > 0 ? (size_t)options.threads : std::max(1u, std::thread::hardware_concurrency());
+	threads = std::max<size_t>(1, std::min(threads, files.size()));
+	batch_t batch(&options, &files, threads);
+	for (size_t i = 0; i < order.size(); i++) batch.queues[i % threads].files.push_back(order[i]);
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> pool;
+	for (size_t i = 1; i < threads; i++) pool.emplace_back(worker, std::ref(batch), i);
+	worker(batch, 0);
+	for (std::thread& thread : pool) thread.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (seconds <= 0) seconds = 1e-9;
+
+	double mb = (double)batch.bytes / 1e6;
+	printf("%zu files, %llu passed, %llu failed, %llu unreadable, %.1f MB in %.3f s: %.1f MB/s, %.0f files/s on %zu threads\n",
+		files.size(), (unsigned long long)batch.passed, (unsigned long long)batch.failed, (unsigned long long)batch.unreadable,
+		mb, seconds, mb / seconds, (double)files.size() / seconds, threads);
+
+	json_schema_free(schema);
+	if (status == 0 && (batch.failed > 0 || batch.unreadable > 0)) status = 1;
+	return status;
+}
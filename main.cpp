@@ -1,86 +1,498 @@
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <string>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define JSON_READAHEAD
+#endif
 #define JSON_TOKENIZER_IMPLEMENTATION
 #include "json_tokenizer.h"
+#include "json_tokenizer.hpp"
 
 const char* passes[] = {
-	"JsonChecker\\pass1.json",
-	"JsonChecker\\pass2.json",
-	"JsonChecker\\pass3.json"
+	"JsonChecker/pass1.json",
+	"JsonChecker/pass2.json",
+	"JsonChecker/pass3.json"
 };
 
 const char* failes[] = {
-	"JsonChecker\\fail1.json",
-	"JsonChecker\\fail2.json",
-	"JsonChecker\\fail3.json",
-	"JsonChecker\\fail4.json",
-	"JsonChecker\\fail5.json",
-	"JsonChecker\\fail6.json",
-	"JsonChecker\\fail7.json",
-	"JsonChecker\\fail8.json",
-	"JsonChecker\\fail9.json",
-	"JsonChecker\\fail10.json",
-	"JsonChecker\\fail11.json",
-	"JsonChecker\\fail12.json",
-	"JsonChecker\\fail13.json",
-	"JsonChecker\\fail14.json",
-	"JsonChecker\\fail15.json",
-	"JsonChecker\\fail16.json",
-	"JsonChecker\\fail17.json",
-	"JsonChecker\\fail18.json",
-	"JsonChecker\\fail19.json",
-	"JsonChecker\\fail20.json",
-	"JsonChecker\\fail21.json",
-	"JsonChecker\\fail22.json",
-	"JsonChecker\\fail23.json",
-	"JsonChecker\\fail24.json",
-	"JsonChecker\\fail25.json",
-	"JsonChecker\\fail26.json",
-	"JsonChecker\\fail27.json",
-	"JsonChecker\\fail28.json",
-	"JsonChecker\\fail29.json",
-	"JsonChecker\\fail30.json",
-	"JsonChecker\\fail31.json",
-	"JsonChecker\\fail32.json",
-	"JsonChecker\\fail33.json"
+	"JsonChecker/fail1.json",
+	"JsonChecker/fail2.json",
+	"JsonChecker/fail3.json",
+	"JsonChecker/fail4.json",
+	"JsonChecker/fail5.json",
+	"JsonChecker/fail6.json",
+	"JsonChecker/fail7.json",
+	"JsonChecker/fail8.json",
+	"JsonChecker/fail9.json",
+	"JsonChecker/fail10.json",
+	"JsonChecker/fail11.json",
+	"JsonChecker/fail12.json",
+	"JsonChecker/fail13.json",
+	"JsonChecker/fail14.json",
+	"JsonChecker/fail15.json",
+	"JsonChecker/fail16.json",
+	"JsonChecker/fail17.json",
+	"JsonChecker/fail18.json",
+	"JsonChecker/fail19.json",
+	"JsonChecker/fail20.json",
+	"JsonChecker/fail21.json",
+	"JsonChecker/fail22.json",
+	"JsonChecker/fail23.json",
+	"JsonChecker/fail24.json",
+	"JsonChecker/fail25.json",
+	"JsonChecker/fail26.json",
+	"JsonChecker/fail27.json",
+	"JsonChecker/fail28.json",
+	"JsonChecker/fail29.json",
+	"JsonChecker/fail30.json",
+	"JsonChecker/fail31.json",
+	"JsonChecker/fail32.json",
+	"JsonChecker/fail33.json"
 };
 
-void replace_backslash(char* path) {
-	if(path == NULL) return;
+// Validate a file, the same tokenizer is reopened for each file.
+int check_json_file(json::tokenizer& json, const char* path)
+{
+	json_reader_t reader;
+	if (json_file_reader(&reader, path) != 0) return -1;
+	json_reopen(json.get(), &reader);
 
-	for (char* p = path; *p != '\0'; ++p) {
-        if (*p == '\\') {
-            *p = '/';
-        }
-    }
+	for (json_token_t tok : json) {
+		if (tok == JSON_ERROR) return 0;
+	}
+	return 1;
 }
 
-int check_json_file(const char* path)
+// Read a whole file into data, returns false if it can not be opened.
+bool read_file(const char* path, std::vector<char>& data)
 {
-	char* path_copy = (char*)malloc(strlen(path) + 1);
-	strcpy(path_copy, path);
+	FILE* fp = fopen(path, "rb");
+	if (fp == NULL) return false;
+	char buf[4096];
+	for (size_t n; (n = fread(buf, 1, sizeof(buf), fp)) > 0;) data.insert(data.end(), buf, buf + n);
+	fclose(fp);
+	return true;
+}
 
-	#if defined(__APPLE__) || defined(__linux__)
-	replace_backslash(path_copy);
-	#endif
+// A path in the temporary directory for a file that a test writes, so the tests leave no files next to their input.
+std::string temp_path(const char* path, const char* extension)
+{
+	std::string name = "json_tokenizer_" + std::filesystem::path(path).filename().string() + extension;
+	return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// Compare the token stream of two tokenizers.
+int compare_json(json::tokenizer& json, json::tokenizer& expected)
+{
+	if (!json || !expected) return -1;
+
+	for (json_token_t tok = expected.next(); tok != JSON_END_DOCUMENT; tok = expected.next()) {
+		if (json.next() != tok || json.value() != expected.value() || json.name() != expected.name()) return 0;
+		if (tok == JSON_ERROR) break;
+	}
+	return 1;
+}
+
+// Copy a file token by token through a json writer, read it back and compare the values.
+int check_json_writer(const char* path)
+{
+	std::string out_path = temp_path(path, ".out");
+	json::tokenizer json = json::tokenizer::open(path);
+	json_writer_t* writer = json_writer_fopen(out_path.c_str());
+	if (!json || writer == NULL) return -1;
+
+	for (json_token_t tok : json) {
+		switch (tok) {
+		case JSON_START_OBJECT: json_write_start_object(writer); break;
+		case JSON_END_OBJECT: json_write_end_object(writer); break;
+		case JSON_START_ARRAY: json_write_start_array(writer); break;
+		case JSON_END_ARRAY: json_write_end_array(writer); break;
+		case JSON_NAME: json_write_name_n(writer, json.name().data(), json.name().size()); break;
+		case JSON_STRING: json_write_string_n(writer, json.value().data(), json.value().size()); break;
+		case JSON_INT64: json_write_int64(writer, json.get_int64()); break;
+		case JSON_UINT64: json_write_uint64(writer, json.get_uint64()); break;
+		case JSON_DOUBLE: json_write_double(writer, json.get_double()); break;
+		case JSON_BOOLEAN: json_write_boolean(writer, json.get_bool()); break;
+		case JSON_NULL: json_write_null(writer); break;
+		default: json_writer_close(writer); return 0;
+		}
+	}
+	if (json_writer_close(writer) != 0) return 0;
+
+	json::tokenizer expected = json::tokenizer::open(path);
+	json::tokenizer written = json::tokenizer::open(out_path.c_str());
+	for (json_token_t tok = expected.next(); tok != JSON_END_DOCUMENT; tok = expected.next()) {
+		if (written.next() != tok || written.name() != expected.name()) return 0;
+		if (tok == JSON_DOUBLE ? written.get_double() != expected.get_double() : written.value() != expected.value()) return 0;
+	}
+	return written.next() == JSON_END_DOCUMENT ? 1 : 0;
+}
+
+// Write doubles that need the shortest digits, 1e23 is 9.999999999999999e22 without them.
+int check_json_doubles()
+{
+	json_writer_t* writer = json_writer_memory();
+	if (writer == NULL) return -1;
+
+	json_write_start_array(writer);
+	for (double value : { 1e23, 0.1, -2.5e-8, 5e-324, 1.7976931348623157e308, 7.1202363472230444e-307, 9007199254740993.0 }) {
+		json_write_double(writer, value);
+	}
+	json_write_end_array(writer);
+	size_t size;
+	const char* data = json_writer_get_buffer(writer, &size);
+	int result = std::string(data, size) == "[1e23,0.1,-2.5e-8,5e-324,1.7976931348623157e308,7.120236347223045e-307,9007199254740992.0]" ? 1 : 0;
+	json_writer_close(writer);
+	return result;
+}
+
+// Minify or pretty print a file into memory, read it back and compare with reading the file directly.
+int check_json_minify(const char* path, int indent)
+{
+	json::tokenizer json = json::tokenizer::open(path);
+	json_writer_t* writer = json_writer_memory();
+	if (!json || writer == NULL) return -1;
+
+	if (json_pretty(json.get(), writer, indent) != JSON_END_DOCUMENT) {
+		json_writer_close(writer);
+		return 0;
+	}
+	size_t size;
+	const char* data = json_writer_get_buffer(writer, &size);
+	json::tokenizer file = json::tokenizer::open(path);
+	json::tokenizer minified(json_open_memory(data, size));
+	int result = compare_json(minified, file);
+	json_writer_close(writer);
+	return result;
+}
+
+// Compare the rest of the tokens and their offsets.
+int compare_offsets(json::tokenizer& json, json::tokenizer& expected)
+{
+	for (json_token_t tok = expected.next(); tok != JSON_END_DOCUMENT; tok = expected.next()) {
+		if (json.next() != tok || json.value() != expected.value() || json.name() != expected.name()) return 0;
+		if (json.offset() != expected.offset()) return 0;
+	}
+	return json.next() == JSON_END_DOCUMENT && json.offset() == expected.offset() ? 1 : 0;
+}
+
+// Index the array in a file, seek to each element in the file and in memory and compare with reading from the start.
+int check_json_seek(const char* path)
+{
+	std::vector<char> data;
+	if (!read_file(path, data)) return -1;
+
+	std::string index_path = temp_path(path, ".idx");
+	json::tokenizer file = json::tokenizer::open(path);
+	json_index_t* built = json_index_build(file.get(), 3);
+	if (built == NULL) return 0;
+	int saved = json_index_save(built, index_path.c_str());
+	json_index_free(built);
+	json_index_t* index = saved == 0 ? json_index_load(index_path.c_str()) : NULL;
+	if (index == NULL) return 0;
+
+	int result = json_index_count(index) > 0 ? 1 : 0;
+	for (uint64_t n = 0; n < json_index_count(index) && result == 1; n++) {
+		json::tokenizer seeked = json::tokenizer::open(path);
+		json::tokenizer memory(json_open_memory(data.data(), data.size()));
+		json::tokenizer expected = json::tokenizer::open(path);
+		json::tokenizer expected_memory = json::tokenizer::open(path);
+		expected.next();
+		expected_memory.next();
+		for (uint64_t i = 0; i < n; i++) {
+			json::skip(expected.get(), expected.next());
+			json::skip(expected_memory.get(), expected_memory.next());
+		}
+		if (json_seek_element(seeked.get(), index, n) != 0 || json_seek_element(memory.get(), index, n) != 0) result = 0;
+		else result = compare_offsets(seeked, expected) && compare_offsets(memory, expected_memory) ? 1 : 0;
+	}
+	json_index_free(index);
+	return result;
+}
+
+// A reader over memory that returns a few bytes at a time.
+struct chunk_reader_t {
+	const std::vector<char>* data;
+	size_t offset;
+};
+
+intptr_t chunk_read(void* user, void* buf, size_t size)
+{
+	chunk_reader_t* reader = (chunk_reader_t*)user;
+	size_t left = reader->data->size() - reader->offset;
+	size = size < left ? size : left;
+	size = size < 7 ? size : 7;
+	memcpy(buf, reader->data->data() + reader->offset, size);
+	reader->offset += size;
+	return (intptr_t)size;
+}
+
+// Capture the objects and arrays at a nesting depth as raw text, from memory and from a reader that
+// returns a few bytes at a time. Compare the text with the source and with reading it token by token.
+int check_json_capture(const char* path, int depth)
+{
+	std::vector<char> data;
+	if (!read_file(path, data)) return -1;
 
-	json_t* sample = json_fopen(path_copy);
-	if (sample == NULL) return -1;
+	int captured = 0;
+	for (int memory = 0; memory < 2; memory++) {
+		chunk_reader_t chunks = { &data, 0 };
+		json_reader_t reader = { chunk_read, NULL, &chunks, NULL };
+		json::tokenizer json(memory ? json_open_memory(data.data(), data.size()) : json_open_reader(&reader));
+		json::tokenizer expected(json_open_memory(data.data(), data.size()));
+		const char* raw;
+		size_t len;
+		if (json_capture_raw(json.get(), &raw, &len) != JSON_ERROR) return 0;
 
-	json_token_t tok = json_next_token(sample);
-	while (tok != JSON_END_DOCUMENT) {
-		if (tok == JSON_ERROR) {
-			return 0;
+		int level = 0;
+		for (json_token_t tok = expected.next(); tok != JSON_END_DOCUMENT; tok = expected.next()) {
+			if (json.next() != tok || json.value() != expected.value() || json.name() != expected.name()) return 0;
+			if (tok == JSON_END_OBJECT || tok == JSON_END_ARRAY) level--;
+			if (tok != JSON_START_OBJECT && tok != JSON_START_ARRAY) continue;
+			if (++level != depth) continue;
+
+			uint64_t offset = expected.offset();
+			if (json_capture_raw(json.get(), &raw, &len) != (tok == JSON_START_OBJECT ? JSON_END_OBJECT : JSON_END_ARRAY)) return 0;
+			if (offset + len > data.size() || memcmp(raw, &data[offset], len) != 0) return 0;
+			if (memory && raw != &data[offset]) return 0;
+
+			json::tokenizer copy(json_open_memory(raw, len));
+			if (copy.next() != tok) return 0;
+			for (int nested = 1; nested > 0;) {
+				json_token_t t = expected.next();
+				if (copy.next() != t || copy.value() != expected.value() || copy.name() != expected.name()) return 0;
+				if (t == JSON_START_OBJECT || t == JSON_START_ARRAY) nested++;
+				else if (t == JSON_END_OBJECT || t == JSON_END_ARRAY) nested--;
+			}
+			if (copy.next() != JSON_END_DOCUMENT) return 0;
+			level--;
+			captured++;
 		}
-		tok = json_next_token(sample);
+		if (json.next() != JSON_END_DOCUMENT) return 0;
+	}
+	return captured > 0 ? 1 : 0;
+}
+
+// Tokenize a document in memory and return the first error.
+std::string check_json_error(const char* text)
+{
+	json::tokenizer json(json_open_memory(text, strlen(text)));
+	for (json_token_t tok : json) {
+		if (tok == JSON_ERROR) return std::string(json.error());
+	}
+	return std::string();
+}
+
+// Validate a document against a schema while tokenizing it, returns the error message or an empty string.
+std::string check_json_schema(json::tokenizer json, const char* schema_text)
+{
+	json::tokenizer schema_json(json_open_memory(schema_text, strlen(schema_text)));
+	json_schema_t* schema = json_schema_compile(schema_json.get());
+	if (schema == NULL) return "invalid schema";
+
+	json_set_schema(json.get(), schema);
+	std::string error;
+	for (json_token_t tok : json) {
+		if (tok == JSON_ERROR) error = json.error();
+	}
+	json_schema_free(schema);
+	return error;
+}
+
+// Minify documents in memory under a schema, the names and strings must still be validated.
+int check_json_minify_schema()
+{
+	const char* schema_text =
+		"{\"type\": \"object\", \"required\": [\"a\"], \"additionalProperties\": false,"
+		" \"properties\": {\"a\": {\"type\": \"string\", \"maxLength\": 3}, \"b\": {\"type\": \"array\"}}}";
+	const char* valid = "{\"a\": \"x\\u00e9\\n\", \"b\": [1, 2.5]}";
+	const char* invalid[] = { "{\"a\": \"x\", \"c\": 1}", "{\"b\": []}", "{\"a\": \"wxyz\"}" };
+	json::tokenizer schema_json(json_open_memory(schema_text, strlen(schema_text)));
+	json_schema_t* schema = json_schema_compile(schema_json.get());
+	if (schema == NULL) return 0;
+
+	json::tokenizer json(json_open_memory(valid, strlen(valid)));
+	json_set_schema(json.get(), schema);
+	json_writer_t* writer = json_writer_memory();
+	int result = json_minify(json.get(), writer) == JSON_END_DOCUMENT ? 1 : 0;
+	size_t size;
+	const char* data = json_writer_get_buffer(writer, &size);
+	json::tokenizer minified(json_open_memory(data, size));
+	json::tokenizer expected(json_open_memory(valid, strlen(valid)));
+	result = result && compare_json(minified, expected) == 1;
+	json_writer_close(writer);
+
+	for (const char* text : invalid) {
+		json::tokenizer bad(json_open_memory(text, strlen(text)));
+		json_set_schema(bad.get(), schema);
+		writer = json_writer_memory();
+		if (json_minify(bad.get(), writer) != JSON_ERROR) result = 0;
+		json_writer_close(writer);
 	}
+	json_schema_free(schema);
+	return result;
+}
 
-	json_close(sample);
+#if defined(__unix__) || defined(__APPLE__)
+int count_token(void* user, json_t*, json_token_t tok)
+{
+	if (tok != JSON_END_DOCUMENT) (*(int*)user)++;
 	return 1;
 }
 
+// Feed a file through a non-blocking pipe a few bytes at a time and compare with reading it directly.
+int check_json_pipe(const char* path)
+{
+	std::vector<char> data;
+	if (!read_file(path, data)) return -1;
+
+	json::tokenizer file = json::tokenizer::open(path);
+	int expected = (int)std::distance(file.begin(), file.end());
+
+	int fds[2];
+	if (pipe(fds) != 0) return -1;
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	json::tokenizer json(json_open_fd(fds[0]));
+
+	int count = 0;
+	size_t offset = 0;
+	json_token_t tok;
+	while ((tok = json_pump(json.get(), count_token, &count)) == JSON_WOULD_BLOCK) {
+		if (offset < data.size()) {
+			size_t size = data.size() - offset < 7 ? data.size() - offset : 7;
+			if (write(fds[1], &data[offset], size) != (ssize_t)size) break;
+			offset += size;
+		}
+		else if (fds[1] != -1) {
+			close(fds[1]);
+			fds[1] = -1;
+		}
+	}
+	if (fds[1] != -1) close(fds[1]);
+	close(fds[0]);
+	return tok == JSON_END_DOCUMENT && count == expected ? 1 : 0;
+}
+
+#ifdef JSON_TOKENIZER_HPP_ASYNC
+// A reactor that writes the next few bytes to the pipe each time the tokenizer waits for input.
+struct pipe_feeder : json::poll_reactor {
+	const std::vector<char>* data;
+	size_t offset;
+	int fd;
+	int waits;
+
+	void wait_readable(int read_fd, void (*callback)(void*), void* user)
+	{
+		waits++;
+		if (offset < data->size()) {
+			size_t size = data->size() - offset < 7 ? data->size() - offset : 7;
+			if (write(fd, &(*data)[offset], size) == (ssize_t)size) offset += size;
+		}
+		else if (fd != -1) {
+			close(fd);
+			fd = -1;
+		}
+		json::poll_reactor::wait_readable(read_fd, callback, user);
+	}
+};
+
+json::detached count_tokens_async(int fd, pipe_feeder& reactor, int& count, json_token_t& last)
+{
+	json::async_tokenizer<pipe_feeder> json(fd, reactor);
+	json_token_t tok;
+	while ((tok = co_await json.next()) != JSON_END_DOCUMENT && tok != JSON_ERROR) count++;
+	last = tok;
+}
+
+// Tokenize a file from a non-blocking pipe in a coroutine and compare with reading it directly.
+int check_json_async(const char* path)
+{
+	std::vector<char> data;
+	if (!read_file(path, data)) return -1;
+
+	json::tokenizer file = json::tokenizer::open(path);
+	int expected = (int)std::distance(file.begin(), file.end());
+
+	int fds[2];
+	if (pipe(fds) != 0) return -1;
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	pipe_feeder reactor;
+	reactor.data = &data;
+	reactor.offset = 0;
+	reactor.fd = fds[1];
+	reactor.waits = 0;
+
+	int count = 0;
+	json_token_t last = JSON_WOULD_BLOCK;
+	count_tokens_async(fds[0], reactor, count, last);
+	bool ran = reactor.run();
+	if (reactor.fd != -1) close(reactor.fd);
+	close(fds[0]);
+	return ran && last == JSON_END_DOCUMENT && count == expected && reactor.waits > 1 ? 1 : 0;
+}
+#endif
+
+// Read a file ahead on a helper thread with small buffers and compare with reading it directly.
+int check_json_readahead(const char* path)
+{
+	json::tokenizer file = json::tokenizer::open(path);
+	json::tokenizer json(json_fopen_readahead(path, 3, 16));
+	return compare_json(json, file);
+}
+#endif
+
+#if defined(JSON_ZLIB) || defined(JSON_ZSTD)
+// Compress a file with zlib or zstd, decompress it while tokenizing and compare with reading it directly.
+int check_json_compressed(const char* path, bool zstd)
+{
+	std::vector<char> data;
+	if (!read_file(path, data)) return -1;
+
+	std::string compressed_path = temp_path(path, zstd ? ".zst" : ".gz");
+	#ifdef JSON_ZLIB
+	if (!zstd) {
+		gzFile gz = gzopen(compressed_path.c_str(), "wb");
+		if (gz == NULL) return -1;
+		gzwrite(gz, data.data(), (unsigned)data.size());
+		gzclose(gz);
+	}
+	#endif
+	#ifdef JSON_ZSTD
+	if (zstd) {
+		std::vector<char> out(ZSTD_compressBound(data.size()));
+		size_t size = ZSTD_compress(out.data(), out.size(), data.data(), data.size(), 3);
+		FILE* fp;
+		if (ZSTD_isError(size) || (fp = fopen(compressed_path.c_str(), "wb")) == NULL) return -1;
+		fwrite(out.data(), 1, size, fp);
+		fclose(fp);
+	}
+	#endif
+
+	json_reader_t reader;
+	if (json_file_reader(&reader, compressed_path.c_str()) != 0) return -1;
+	#ifdef JSON_ZLIB
+	if (!zstd && json_inflate(&reader) != 0) return -1;
+	#endif
+	#ifdef JSON_ZSTD
+	if (zstd && json_zstd(&reader) != 0) return -1;
+	#endif
+
+	json::tokenizer file = json::tokenizer::open(path);
+	json::tokenizer json(json_open_reader(&reader));
+	return compare_json(json, file);
+}
+#endif
+
 enum class gender_t { MALE, FEMALE };
 
 struct person_t {
@@ -92,15 +504,148 @@ struct person_t {
 	std::vector<std::string> tags;
 };
 
+// Read gender_t from the strings "male" and "female".
+template<>
+struct json::value_reader<gender_t> {
+	static bool read(json_t* json, json_token_t tok, gender_t& out)
+	{
+		if (tok != JSON_STRING) return false;
+		out = strcmp(json_get_value(json), "male") == 0 ? gender_t::MALE : gender_t::FEMALE;
+		return true;
+	}
+};
+
+// The favoriteFruit key is not declared and will be skipped.
+JSON_BIND(person_t,
+	JSON_FIELD(age),
+	JSON_FIELD(name),
+	JSON_FIELD(gender),
+	JSON_FIELD(company),
+	JSON_FIELD(email),
+	JSON_FIELD(tags));
+
+struct point_t {
+	double x;
+	float y;
+};
+
+JSON_BIND(point_t,
+	JSON_FIELD(x),
+	JSON_FIELD(y));
+
+// Read floating point fields, 17 digits must give the nearest double and a string is not a number.
+int check_json_read_numbers()
+{
+	const char* text = "[{\"x\": 864.67870365114823, \"y\": 0.1}, {\"x\": -1.7976931348623157e308, \"y\": 3}]";
+	json::tokenizer json(json_open_memory(text, strlen(text)));
+	std::vector<point_t> points;
+	if (!json::read(json, points) || points.size() != 2) return 0;
+	if (points[0].x != 864.67870365114823 || points[0].y != 0.1f || points[1].x != -1.7976931348623157e308 || points[1].y != 3.0f) return 0;
+
+	const char* string = "{\"x\": \"1.5\"}";
+	json::tokenizer invalid(json_open_memory(string, strlen(string)));
+	point_t point;
+	return !json::read(invalid, point) ? 1 : 0;
+}
+
+// Convert the current token with json::tokenizer::get, only numbers convert to a double.
+int check_json_get()
+{
+	const char* text = "[864.67870365114823, \"abc\", true, -7]";
+	json::tokenizer json(json_open_memory(text, strlen(text)));
+	double d = 0;
+	int result = json.next() == JSON_START_ARRAY && json.next() == JSON_DOUBLE && json.get(d) && d == 864.67870365114823 ? 1 : 0;
+	result = result && json.next() == JSON_STRING && !json.get(d);
+	result = result && json.next() == JSON_BOOLEAN && !json.get(d);
+	return result && json.next() == JSON_INT64 && json.get(d) && d == -7.0 ? 1 : 0;
+}
+
+// Read a stream of records into the same struct, the values of each record replace the previous.
+int check_json_read_reuse()
+{
+	const char* ndjson = "{\"name\": \"a\", \"tags\": [\"x\", \"y\", \"z\"]}\n{\"name\": \"b\", \"tags\": [\"w\"]}\n";
+	json::tokenizer json(json_open_memory(ndjson, strlen(ndjson)));
+	json_set_stream(json.get(), 1);
+	person_t person;
+	if (!json::read(json, person) || person.tags.size() != 3) return 0;
+	if (!json::read(json, person)) return 0;
+	return person.name == "b" && person.tags.size() == 1 && person.tags[0] == "w" ? 1 : 0;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+// Read structs from a non-blocking pipe that runs dry in a skipped key, json::read must fail instead of waiting.
+int check_json_read_would_block()
+{
+	const char* data = "[{\"age\": 20, \"favoriteFruit\": [1, {\"a\": ";
+	int fds[2];
+	if (pipe(fds) != 0) return -1;
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	ssize_t written = write(fds[1], data, strlen(data));
+	json::tokenizer json(json_open_fd(fds[0]));
+	std::vector<person_t> persons;
+	int result = written == (ssize_t)strlen(data) && !json::read(json, persons) && persons.size() == 1 && persons[0].age == 20 ? 1 : 0;
+	close(fds[1]);
+	close(fds[0]);
+	return result;
+}
+#endif
+
+// An empty column, C++17 has no designated initializers so every member is listed.
+json_column_t make_column(const char* name, json_column_type_t type)
+{
+	json_column_t column = { name, type, 0, 0, 0, NULL, NULL, NULL, { 0, 0, 0 } };
+	return column;
+}
+
+// Extract columns from a file and compare with reading it into structs, and from an NDJSON stream.
+int check_json_columns(const char* path)
+{
+	json::tokenizer file = json::tokenizer::open(path);
+	std::vector<person_t> persons;
+	if (!json::read(file, persons)) return -1;
+
+	json_column_t columns[] = { make_column("age", JSON_COLUMN_INT64), make_column("name", JSON_COLUMN_STRING), make_column("tags", JSON_COLUMN_STRING) };
+	json::tokenizer json = json::tokenizer::open(path);
+	int result = json_extract_columns(json.get(), columns, 3, 4) == 4 && json_extract_columns(json.get(), columns, 3, 4) == (int64_t)persons.size() - 4 ? 1 : 0;
+	result = result && json_extract_columns(json.get(), columns, 3, 4) == 0 && columns[0].length == persons.size() && columns[2].null_count == persons.size();
+	for (size_t i = 0; i < columns[0].length && result; i++) {
+		const int64_t* offsets = (const int64_t*)columns[1].values;
+		std::string name(columns[1].data + offsets[i], (size_t)(offsets[i + 1] - offsets[i]));
+		result = ((const int64_t*)columns[0].values)[i] == persons[i].age && name == persons[i].name;
+	}
+	json_columns_free(columns, 3);
+
+	const char* ndjson = "{\"age\": 1, \"name\": \"a\"}\n{\"name\": null}\n{\"age\": 3.5, \"name\": \"c\"}\n";
+	json::tokenizer stream(json_open_memory(ndjson, strlen(ndjson)));
+	json_set_stream(stream.get(), 1);
+	json_column_t ages = make_column("age", JSON_COLUMN_DOUBLE);
+	result = result && json_extract_columns(stream.get(), &ages, 1, 100) == 3 && ages.null_count == 1;
+	result = result && ((const double*)ages.values)[0] == 1.0 && ((const double*)ages.values)[2] == 3.5 && ages.validity[0] == 5;
+	json_columns_free(&ages, 1);
+
+	// 17 significant digits must convert to the nearest double.
+	const char* precise = "{\"x\": 864.67870365114823}\n{\"x\": 1.7976931348623157e308}\n{\"x\": 2.2250738585072014e-308}\n{\"x\": 0.30000000000000004}\n";
+	json::tokenizer precise_stream(json_open_memory(precise, strlen(precise)));
+	json_set_stream(precise_stream.get(), 1);
+	json_column_t xs = make_column("x", JSON_COLUMN_DOUBLE);
+	result = result && json_extract_columns(precise_stream.get(), &xs, 1, 100) == 4;
+	const double* x = (const double*)xs.values;
+	result = result && x[0] == 864.67870365114823 && x[1] == 1.7976931348623157e308 && x[2] == 2.2250738585072014e-308 && x[3] == 0.30000000000000004;
+	json_columns_free(&xs, 1);
+	return result;
+}
+
 int main(void)
 {
 	//
 	// Test the tokenizer with the sample file from [https://www.json.org/JSON_checker/].
 
+	json::tokenizer checker(json_open_memory("", 0));
+
 	// Test the pass files
 	for (int i = 0; i < sizeof(passes) / sizeof(const char*); i++) {
 		printf("%s: ", passes[i]);
-		int result = check_json_file(passes[i]);
+		int result = check_json_file(checker, passes[i]);
 		if (result == -1) {
 			printf("failed open file!\n");
 		}
@@ -115,7 +660,7 @@ int main(void)
 	// Test the fail files
 	for (int i = 0; i < sizeof(failes) / sizeof(const char*); i++) {
 		printf("%s: ", failes[i]);
-		int result = check_json_file(failes[i]);
+		int result = check_json_file(checker, failes[i]);
 		if (result == -1) {
 			printf("failed open file!\n");
 		}
@@ -127,64 +672,126 @@ int main(void)
 		}
 	}
 
+	// Test the row and column of errors after numbers
+	printf("memory (error position): ");
+	printf(check_json_error("{\"a\": [0,1,2,3],}") == "Error(1,17): Unexpected sign." &&
+		check_json_error("[1.5, -2e3 }") == "Error(1,12): Unexpected sign." ? "ok\n" : "failed!\n");
+
+	// Test iterating a file that can not be opened
+	printf("missing.json (iterate): ");
+	int missing = 0;
+	for (json_token_t tok : json::tokenizer::open("missing.json")) missing += tok != JSON_ERROR;
+	printf(missing == 0 ? "ok\n" : "failed!\n");
+
+	// Test the json writer
+	for (const char* path : { "JsonChecker/pass1.json", "sample.json" }) {
+		printf("%s (writer): ", path);
+		printf(check_json_writer(path) == 1 ? "ok\n" : "failed!\n");
+	}
+
+	printf("memory (shortest doubles): ");
+	printf(check_json_doubles() == 1 ? "ok\n" : "failed!\n");
+
+	// Test minify and pretty print
+	for (const char* path : { "JsonChecker/pass1.json", "sample.json" }) {
+		printf("%s (minify): ", path);
+		printf(check_json_minify(path, 0) == 1 ? "ok\n" : "failed!\n");
+		printf("%s (pretty): ", path);
+		printf(check_json_minify(path, 2) == 1 ? "ok\n" : "failed!\n");
+	}
+
+	// Test schema validation
+	const char* person_schema =
+		"{\"type\": \"array\", \"items\": {\"type\": \"object\", \"required\": [\"age\", \"name\", \"tags\"],"
+		" \"properties\": {\"age\": {\"type\": \"integer\", \"minimum\": 0, \"maximum\": 39},"
+		" \"name\": {\"type\": \"string\", \"minLength\": 1}, \"tags\": {\"type\": \"array\", \"items\": {\"type\": \"string\"}}}}}";
+	printf("sample.json (schema): ");
+	printf(check_json_schema(json::tokenizer::open("sample.json"), person_schema) == "Error(88,14): $[5].age: Value is greater than the maximum." ? "ok\n" : "failed!\n");
+
+	printf("memory (schema maximum): ");
+	printf(check_json_schema(json::tokenizer(json_open_memory("[1.79769313486231570e308]", 25)), "{\"items\": {\"maximum\": 1.7976931348623157e308}}").empty() ? "ok\n" : "failed!\n");
+
+	printf("memory (minify with schema): ");
+	printf(check_json_minify_schema() == 1 ? "ok\n" : "failed!\n");
+
+	// Test columnar extraction
+	printf("sample.json (columns): ");
+	printf(check_json_columns("sample.json") == 1 ? "ok\n" : "failed!\n");
+
+	// Test seeking to the elements of an array
+	for (const char* path : { "JsonChecker/pass1.json", "sample.json" }) {
+		printf("%s (seek): ", path);
+		printf(check_json_seek(path) == 1 ? "ok\n" : "failed!\n");
+	}
+
+	// Test capturing objects and arrays as raw text
+	for (const char* path : { "JsonChecker/pass1.json", "sample.json" }) {
+		for (int depth = 1; depth <= 3; depth++) {
+			printf("%s (capture depth %d): ", path, depth);
+			printf(check_json_capture(path, depth) == 1 ? "ok\n" : "failed!\n");
+		}
+	}
+
+	// Test converting the current token
+	printf("memory (get): ");
+	printf(check_json_get() == 1 ? "ok\n" : "failed!\n");
+
+	// Test reading floating point numbers
+	printf("memory (read numbers): ");
+	printf(check_json_read_numbers() == 1 ? "ok\n" : "failed!\n");
+
+	// Test reading records into the same struct
+	printf("memory (read reuse): ");
+	printf(check_json_read_reuse() == 1 ? "ok\n" : "failed!\n");
+
+#if defined(__unix__) || defined(__APPLE__)
+	// Test the tokenizer on a non-blocking pipe
+	printf("sample.json (non-blocking pipe): ");
+	printf(check_json_pipe("sample.json") == 1 ? "ok\n" : "failed!\n");
+
+	// Test json::read on input that would block
+	printf("pipe (read would block): ");
+	printf(check_json_read_would_block() == 1 ? "ok\n" : "failed!\n");
+
+#ifdef JSON_TOKENIZER_HPP_ASYNC
+	// Test the C++20 awaitable tokenizer on a non-blocking pipe
+	printf("sample.json (async pipe): ");
+	printf(check_json_async("sample.json") == 1 ? "ok\n" : "failed!\n");
+#endif
+
+	// Test the tokenizer with read-ahead
+	printf("sample.json (read-ahead): ");
+	printf(check_json_readahead("sample.json") == 1 ? "ok\n" : "failed!\n");
+#endif
+
+#ifdef JSON_ZLIB
+	// Test the tokenizer on gzip input
+	printf("sample.json (gzip): ");
+	printf(check_json_compressed("sample.json", false) == 1 ? "ok\n" : "failed!\n");
+#endif
+
+#ifdef JSON_ZSTD
+	// Test the tokenizer on zstd input
+	printf("sample.json (zstd): ");
+	printf(check_json_compressed("sample.json", true) == 1 ? "ok\n" : "failed!\n");
+#endif
+
 	//
 	// Example: Read from a sample file and put the result in a struct.
 	//
 	
-	json_t* sample = json_fopen("sample.json");
-	if(sample == nullptr) {
+	json::tokenizer sample = json::tokenizer::open("sample.json");
+	if(!sample) {
 		printf("Failed to open sample.json");
 		exit(-1);
 	}
-	json_token_t tok;
 	std::vector<person_t> persons;
-
-	// Search for the start of the object
-	while((tok = json_next_token(sample)) != JSON_START_ARRAY) {}
-	while(true) {
-		person_t person;
-
-		// If the next token is the end of the array then we are done.
-		if((tok = json_next_token(sample)) == JSON_END_ARRAY) break;
-		
-		// Read age
-		while((tok = json_next_token(sample)) != JSON_NAME) {}
-		while((tok = json_next_token(sample)) != JSON_UINT64) {}
-		person.age = static_cast<int>(std::atol(json_get_value(sample)));
-
-		// Read name
-		while((tok = json_next_token(sample)) != JSON_NAME) {}
-		while((tok = json_next_token(sample)) != JSON_STRING) {}
-		person.name = json_get_value(sample);
-
-		// Read gender
-		while((tok = json_next_token(sample)) != JSON_NAME) {}
-		while((tok = json_next_token(sample)) != JSON_STRING) {}
-		person.gender = strcmp(json_get_value(sample), "male") ? gender_t::MALE : gender_t::FEMALE;
-
-		// Read company
-		while((tok = json_next_token(sample)) != JSON_NAME) {}
-		while((tok = json_next_token(sample)) != JSON_STRING) {}
-		person.company = json_get_value(sample);
-
-		// Read email
-		while((tok = json_next_token(sample)) != JSON_NAME) {}
-		while((tok = json_next_token(sample)) != JSON_STRING) {}
-		person.email = json_get_value(sample);
-
-		// Read the tags
-		while((tok = json_next_token(sample)) != JSON_START_ARRAY) {}
-		while(true) {
-			if((tok = json_next_token(sample)) == JSON_END_ARRAY) break;;
-			person.tags.push_back(json_get_value(sample));
-		}
-
-		// skip favoriteFruit
-
-		// Search for the end of the object
-		while((tok = json_next_token(sample)) != JSON_END_OBJECT) {}
-
-		persons.push_back(person);
+	if (!json::read(sample, persons)) {
+		printf("sample.json: failed! %.*s\n", (int)sample.error().size(), sample.error().data());
 	}
+	else {
+		printf("sample.json: ok, %d persons\n", (int)persons.size());
+	}
+
 	return 0;
 }
\ No newline at end of file